@@ -0,0 +1,454 @@
+// Microbenchmarks for the draw paths and the brick collision loop. Draws
+// go to an offscreen surface through SDL_CreateSoftwareRenderer, so no
+// display is needed; every draw ends with SDL_RenderFlush so the pixels
+// are really filled inside the timed part.
+//
+// Usage: Bench [--quick] [--json results.json]
+//        Bench --compare baseline.json results.json [percent]
+//
+// Every result is the median of five runs, each long enough to time
+// well, in nanoseconds per item: a circle, a brick, a query. --compare
+// lists every result of both files side by side and fails when one got
+// slower than the baseline by more than percent (10 by default).
+//
+// On Linux, from this folder, with SOURCES being Balls, Bricks, Functions,
+// Game, Generator, Grid, Level, Particles, Timing and Trace.cpp of the Life:
+//   g++ -O2 -std=c++14 -pthread -I "../the Life" $(sdl2-config --cflags) -o bench Bench.cpp SOURCES $(sdl2-config --libs)
+
+// fopen is fine here, SDL checks would make it an error
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Header.h"
+#include "Grid.h"
+
+static const int FIELD = 1024;  // The offscreen surface is FIELD x FIELD
+
+struct BenchResult
+{
+  std::string name;
+  int bricks;       // 0 where the count doesn't apply
+  double ns;        // Per item
+  const char* unit; // What an item is
+};
+
+static double target_seconds = 0.02;  // Shortest run that is timed
+static std::vector<BenchResult> results;
+
+// Nanoseconds per item of op, which does items of them a call. The
+// repetitions double until a run lasts target_seconds, then five runs
+// of that many give the median
+template <class F>
+static double Measure(int items, F op)
+{
+  Uint64 frequency = SDL_GetPerformanceFrequency();
+  Uint64 start, ticks;
+  double runs[5];
+  long long reps = 1, r;
+  int k;
+
+  for (;;)
+  {
+    start = SDL_GetPerformanceCounter();
+    for (r = 0; r < reps; r++)
+      op();
+    ticks = SDL_GetPerformanceCounter() - start;
+    if ((double)ticks / frequency >= target_seconds || reps >= (1LL << 30))
+      break;
+    reps *= 2;
+  }
+
+  for (k = 0; k < 5; k++)
+  {
+    start = SDL_GetPerformanceCounter();
+    for (r = 0; r < reps; r++)
+      op();
+    ticks = SDL_GetPerformanceCounter() - start;
+    runs[k] = (double)ticks * 1e9 / frequency / ((double)reps * items);
+  }
+
+  std::sort(runs, runs + 5);
+  return runs[2];
+}
+
+static void Report(const char* name, int bricks, double ns, const char* unit)
+{
+  BenchResult result = { name, bricks, ns, unit };
+
+  results.push_back(result);
+  if (bricks > 0)
+    printf("%-24s %8d %12.3f ns per %s\n", name, bricks, ns, unit);
+  else
+    printf("%-24s %8s %12.3f ns per %s\n", name, "", ns, unit);
+}
+
+// count bricks in a square grid over the field, eight colors, about a
+// quarter of them already destroyed
+static void BuildField(BrickSoA& bricks, int count)
+{
+  static const uint32_t colors[8] = { 0xFF0000FF, 0x00FF00FF, 0x0000FFFF, 0xFFFF00FF,
+                                      0xFF00FFFF, 0x00FFFFFF, 0xFF8000FF, 0x8080FFFF };
+  int columns = (int)ceil(sqrt((double)count));
+  int cell = std::max(1, FIELD / columns);
+  int size = std::max(1, cell - 2);
+  unsigned seed = 12345;
+  int i;
+
+  bricks.Clear();
+  for (i = 0; i < count; i++)
+    bricks.Add(i % columns * cell, i / columns * cell, size, size, colors[i % 8]);
+
+  for (i = 0; i < count; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    if ((seed >> 16) % 4 == 0)
+      bricks.Kill(i);
+  }
+}
+
+static void BenchSprites(SDL_Renderer* renderer)
+{
+  const int n = 1000;
+  GeometryBatch batch;
+  ParticlePool particles;
+  Circle circle;
+  Platform platform;
+  std::vector<SDL_Point> where(n);
+  SDL_Color white = { 255, 255, 255, 255 };
+  unsigned seed = 777;
+  int i;
+
+  for (i = 0; i < n; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    where[i].x = (int)((seed >> 8) % (FIELD - 20));
+    seed = seed * 1103515245 + 12345;
+    where[i].y = (int)((seed >> 8) % (FIELD - 20));
+  }
+
+  // One SDL_RenderCopy per ball, the way balls used to be drawn
+  Report("circle.copy", 0, Measure(n, [&]()
+  {
+    for (int k = 0; k < n; k++)
+    {
+      circle.pos_x = where[k].x;
+      circle.pos_y = where[k].y;
+      circle.Draw(renderer);
+    }
+    SDL_RenderFlush(renderer);
+  }), "circle");
+
+  Report("circle.batch", 0, Measure(n, [&]()
+  {
+    for (int k = 0; k < n; k++)
+    {
+      circle.pos_x = where[k].x;
+      circle.pos_y = where[k].y;
+      circle.Draw(renderer, batch);
+    }
+    batch.Flush(renderer);
+    SDL_RenderFlush(renderer);
+  }), "circle");
+
+  platform.pos_x = 412;
+  platform.pos_y = FIELD - 50;
+  platform.weight = 200;
+  platform.hight = 20;
+
+  Report("platform.fill", 0, Measure(1, [&]()
+  {
+    platform.Draw(NULL, renderer, 255, 255, 255, 255);
+    SDL_RenderFlush(renderer);
+  }), "paddle");
+
+  Report("platform.batch", 0, Measure(1, [&]()
+  {
+    platform.Draw(batch, white);
+    batch.Flush(renderer);
+    SDL_RenderFlush(renderer);
+  }), "paddle");
+
+  // A ring full of sparks, as after a big chain of bricks
+  particles.Reserve(4096);
+  for (i = 0; i < 4096; i++)
+    particles.Emit((float)where[i % n].x, (float)where[i % n].y, 0, 0, 0xFF8000FF);
+
+  Report("particles.batch", 0, Measure(particles.Count(), [&]()
+  {
+    DrawParticles(particles, batch);
+    batch.Flush(renderer);
+    SDL_RenderFlush(renderer);
+  }), "particle");
+
+  circle.Release();
+}
+
+static void BenchBricks(SDL_Renderer* renderer, int count)
+{
+  BrickSoA bricks;
+  BrickBatch fill;
+  BrickLayer layer;
+  GeometryBatch batch;
+
+  BuildField(bricks, count);
+  fill.Rebuild(bricks);
+
+  // Sorting the live bricks into color groups, after every destroyed one
+  Report("bricks.rebuild", count, Measure(count, [&]()
+  {
+    fill.Rebuild(bricks);
+  }), "brick");
+
+  Report("bricks.fill_rects", count, Measure(count, [&]()
+  {
+    fill.Draw(renderer);
+    SDL_RenderFlush(renderer);
+  }), "brick");
+
+  Report("bricks.batch", count, Measure(count, [&]()
+  {
+    fill.Draw(batch);
+    batch.Flush(renderer);
+    SDL_RenderFlush(renderer);
+  }), "brick");
+
+  // The cached layer costs one copy a frame whatever the count
+  if (layer.Update(renderer, bricks, 0))
+  {
+    Report("bricks.layer_copy", count, Measure(1, [&]()
+    {
+      layer.Draw(renderer);
+      SDL_RenderFlush(renderer);
+    }), "frame");
+  }
+  layer.Release();
+}
+
+static void BenchCollide(int count)
+{
+  static const char* names[] = { "collide.scan.scalar", "collide.scan.sse2", "collide.scan.avx2" };
+  int detected = BrickSoA::DetectKernel();
+  BrickSoA bricks;
+  BrickGrid grid;
+  std::vector<int> out(count);
+  std::vector<int> boxes(2048);
+  unsigned seed = 4242;
+  long long hits = 0;
+  size_t q;
+  int kernel;
+
+  BuildField(bricks, count);
+  grid.Build(bricks);
+
+  // Ball sized boxes anywhere over the field
+  for (q = 0; q < boxes.size(); q++)
+  {
+    seed = seed * 1103515245 + 12345;
+    boxes[q] = (int)((seed >> 8) % (FIELD - 20));
+  }
+
+  // Every brick tested against the ball, as the tick loop did
+  for (kernel = 0; kernel <= detected; kernel++)
+  {
+    BrickSoA::SelectKernel(kernel);
+    q = 0;
+    Report(names[kernel], count, Measure(count, [&]()
+    {
+      int x = boxes[q], y = boxes[q + 1];
+
+      q = (q + 2) % boxes.size();
+      hits += bricks.FindOverlaps(0, count, x, y, x + 20, y + 20, out.data());
+    }), "brick");
+  }
+  BrickSoA::SelectKernel(detected);
+
+  // Only the bricks in the cells around the ball
+  q = 0;
+  Report("collide.grid", count, Measure(1, [&]()
+  {
+    float x = (float)boxes[q], y = (float)boxes[q + 1];
+
+    q = (q + 2) % boxes.size();
+    grid.Query(x, y, x + 20, y + 20, [&](int index)
+    {
+      hits += index;
+    });
+  }), "query");
+
+  // Keeps the loops from being thrown away
+  if (hits == -1)
+    printf("\n");
+}
+
+// NULL on success, else what went wrong
+static const char* WriteJson(const char* path)
+{
+  static const char* kernels[] = { "scalar", "sse2", "avx2" };
+  FILE* file;
+  size_t i;
+  bool ok;
+
+  file = fopen(path, "w");
+  if (file == NULL)
+    return "cannot create the file";
+
+  // One result a line, --compare reads them back the same way
+  fprintf(file, "{\n  \"renderer\": \"software\",\n  \"kernel\": \"%s\",\n  \"field\": %d,\n  \"results\": [\n",
+          kernels[BrickSoA::DetectKernel()], FIELD);
+  for (i = 0; i < results.size(); i++)
+    fprintf(file, "    { \"name\": \"%s\", \"bricks\": %d, \"ns\": %.4f, \"unit\": \"%s\" }%s\n",
+            results[i].name.c_str(), results[i].bricks, results[i].ns, results[i].unit,
+            i + 1 < results.size() ? "," : "");
+  fprintf(file, "  ]\n}\n");
+
+  ok = !ferror(file);
+  ok = fclose(file) == 0 && ok;
+
+  return ok ? NULL : "cannot write the file";
+}
+
+// The results of a file WriteJson wrote. NULL on success
+static const char* ReadJson(const char* path, std::vector<BenchResult>& out)
+{
+  FILE* file = fopen(path, "r");
+  char line[512], name[128];
+  const char* at;
+  BenchResult result;
+
+  if (file == NULL)
+    return "cannot open it";
+
+  out.clear();
+  while (fgets(line, sizeof(line), file) != NULL)
+  {
+    at = strstr(line, "\"name\":");
+    if (at == NULL || sscanf(at, "\"name\": \"%127[^\"]\"", name) != 1)
+      continue;
+
+    result.name = name;
+    result.unit = "";
+    at = strstr(line, "\"bricks\":");
+    result.bricks = at != NULL ? atoi(at + 9) : 0;
+    at = strstr(line, "\"ns\":");
+    if (at == NULL)
+      continue;
+    result.ns = atof(at + 5);
+    out.push_back(result);
+  }
+
+  fclose(file);
+  return out.empty() ? "no results in it" : NULL;
+}
+
+static int Compare(const char* baseline_path, const char* current_path, double percent)
+{
+  std::vector<BenchResult> baseline, current;
+  const char* error;
+  double change;
+  int regressions = 0;
+  size_t i, k;
+
+  error = ReadJson(baseline_path, baseline);
+  if (error == NULL)
+    error = ReadJson(current_path, current);
+  if (error != NULL)
+  {
+    printf("%s: %s\n", baseline.empty() ? baseline_path : current_path, error);
+    return 1;
+  }
+
+  printf("%-24s %8s %12s %12s %9s\n", "benchmark", "bricks", "baseline ns", "current ns", "change");
+
+  for (i = 0; i < current.size(); i++)
+  {
+    for (k = 0; k < baseline.size(); k++)
+      if (baseline[k].name == current[i].name && baseline[k].bricks == current[i].bricks)
+        break;
+
+    if (k == baseline.size())
+    {
+      printf("%-24s %8d %12s %12.3f %9s\n", current[i].name.c_str(), current[i].bricks, "-", current[i].ns, "new");
+      continue;
+    }
+
+    change = baseline[k].ns > 0 ? 100.0 * (current[i].ns - baseline[k].ns) / baseline[k].ns : 0.0;
+    printf("%-24s %8d %12.3f %12.3f %+8.1f%%%s\n", current[i].name.c_str(), current[i].bricks, baseline[k].ns,
+           current[i].ns, change, change > percent ? "  REGRESSION" : change < -percent ? "  faster" : "");
+    if (change > percent)
+      regressions++;
+  }
+
+  printf("%d of %d slower than the baseline by more than %.1f%%\n", regressions, (int)current.size(), percent);
+
+  return regressions > 0 ? 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+  static const int counts[] = { 4, 64, 1000, 10000, 100000, 1000000 };
+  const char* json_path = "bench.json";
+  int max_count = 1000000;
+  SDL_Surface* surface;
+  SDL_Renderer* renderer;
+  const char* error;
+  size_t k;
+  int i;
+
+  if (argc > 3 && strcmp(argv[1], "--compare") == 0)
+    return Compare(argv[2], argv[3], argc > 4 ? atof(argv[4]) : 10.0);
+
+  for (i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--quick") == 0)
+    {
+      target_seconds = 0.005;
+      max_count = 10000;
+    }
+    if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+      json_path = argv[++i];
+  }
+
+  SDL_Init(0);
+
+  // Offscreen, the software renderer draws straight into the surface
+  surface = SDL_CreateRGBSurfaceWithFormat(0, FIELD, FIELD, 32, SDL_PIXELFORMAT_ARGB8888);
+  renderer = surface != NULL ? SDL_CreateSoftwareRenderer(surface) : NULL;
+  if (renderer == NULL)
+  {
+    printf("No software renderer: %s\n", SDL_GetError());
+    return 1;
+  }
+
+  BrickSoA::SelectKernel(BrickSoA::DetectKernel());
+
+  BenchSprites(renderer);
+
+  for (k = 0; k < sizeof(counts) / sizeof(counts[0]) && counts[k] <= max_count; k++)
+  {
+    BenchBricks(renderer, counts[k]);
+    BenchCollide(counts[k]);
+  }
+
+  SDL_DestroyRenderer(renderer);
+  SDL_FreeSurface(surface);
+  SDL_Quit();
+
+  error = WriteJson(json_path);
+  if (error != NULL)
+  {
+    printf("%s: %s\n", json_path, error);
+    return 1;
+  }
+  printf("Results in %s\n", json_path);
+
+  return 0;
+}
@@ -0,0 +1,1029 @@
+// Runs games without a window as fast as the CPU allows and
+// reports simulated ticks per second.
+//
+// Usage: Headless [--level file] [games] [max ticks per game] [ticks per second] [ball speed]
+//        Headless --handoff [ticks]
+//        Headless --check-corner
+//        Headless --bench-grid [ticks]
+//        Headless --bench-kernel
+//        Headless --convert level.txt level.bin
+//        Headless --bench-level [bricks] [file]
+//        Headless --generate grid|noise|maze|sizes seed columns rows level.bin
+//        Headless --bench-generate [columns] [rows]
+//        Headless --bench-balls
+//        Headless --bench-particles
+//        Headless [--level file] --record session.rep [max ticks]
+//        Headless [--level file] --replay session.rep [times]
+//        Headless [--level file] --batch [games] [threads] [max ticks per game]
+//        Headless [--level file] --bench-env [games] [threads] [steps]
+//        Headless [--level file] --bench-wide [games] [max ticks per game] [threads]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "Batch.h"
+#include "Classic.h"
+#include "Env.h"
+#include "Game.h"
+#include "Generator.h"
+#include "Particles.h"
+#include "Replay.h"
+#include "TripleBuffer.h"
+
+// Simple player: keep the middle of the paddle under the ball
+static GameInput FollowBall(const Game& game)
+{
+  GameInput input;
+  float ball = game.ball.pos_x + 10;
+  float paddle = game.paddle.pos_x + game.paddle.weight / 2;
+  float step = game.paddle.speed_x * game.tick_seconds;
+
+  input.move = 0;
+  input.spawn = 0;
+  if (ball < paddle - step)
+    input.move = -1;
+  if (ball > paddle + step)
+    input.move = 1;
+
+  return input;
+}
+
+// One thread steps games and publishes a snapshot every tick, another
+// thread consumes them, the same handoff the window build uses between
+// its simulation and main threads. Meant to be run under ThreadSanitizer.
+static int Handoff(long long ticks)
+{
+  TripleBuffer<GameSnapshot> snapshots;
+  std::atomic<bool> done(false);
+  long long read = 0, torn = 0;
+  Game game;
+  float limit = game.ball.speed_x * game.tick_seconds + 1;  // Furthest one tick moves the ball
+
+  snapshots.Back().previous_ball = game.ball;
+  snapshots.Back().previous_paddle = game.paddle;
+  game.Snapshot(snapshots.Back());
+  snapshots.Publish();
+
+  std::thread simulation([&]()
+  {
+    long long t;
+
+    for (t = 0; t < ticks; t++)
+    {
+      GameSnapshot& snapshot = snapshots.Back();
+
+      if (game.result != Game::PLAYING)
+        game.Reset();
+
+      snapshot.previous_ball = game.ball;
+      snapshot.previous_paddle = game.paddle;
+      game.Step(FollowBall(game));
+      game.Snapshot(snapshot);
+      snapshots.Publish();
+    }
+
+    done.store(true);
+  });
+
+  while (!done.load())
+  {
+    if (!snapshots.Update())
+      continue;
+
+    const GameSnapshot& state = snapshots.Front();
+    int alive = state.bricks.Remaining();
+
+    // A snapshot mixing two ticks would move the ball further than one tick allows
+    if (fabsf(state.ball.pos_x - state.previous_ball.pos_x) > limit ||
+        fabsf(state.ball.pos_y - state.previous_ball.pos_y) > limit || alive > state.bricks.Count())
+      torn++;
+
+    read++;
+  }
+
+  simulation.join();
+
+  printf("%lld ticks published, %lld snapshots read, %lld inconsistent\n", ticks, read, torn);
+
+  return torn == 0 ? 0 : 1;
+}
+
+// Rows of small bricks filling the top of a field wide enough for count
+// bricks, a full-width paddle so the game never ends early
+static void BuildWall(Game& game, int count)
+{
+  int columns = (int)ceil(sqrt(count * 3.0));
+  int i;
+
+  game.Reset();
+  game.width = columns * 32 + 20;
+  game.height = (count + columns - 1) / columns * 14 + 420;
+
+  game.ClearBricks();
+  for (i = 0; i < count; i++)
+    game.AddBrick(10 + i % columns * 32, 10 + i / columns * 14, 30, 12, 0xFF00FFFF);
+  game.BuildGrid();
+
+  game.paddle.pos_x = 0;
+  game.paddle.pos_y = (float)(game.height - 50);
+  game.paddle.weight = game.width;
+  game.ball.pos_x = game.width / 2.0f;
+  game.ball.pos_y = game.height - 100.0f;
+  game.directionY = -1;
+}
+
+// A ball passing just clear of a brick's rounded corner, and one moving
+// into it. Inside the radius-grown box but 1.3 pixels from the corner,
+// the first has to fly on with the brick standing
+static int CheckCorner()
+{
+  static const float moves[2][2] = { { 1.0f, 0.1f }, { 5.0f, 5.0f } };  // Pixels per tick
+  static const bool hits[2] = { false, true };
+  Game game;
+  GameInput input = { 0, 0 };
+  int k, failed = 0;
+
+  for (k = 0; k < 2; k++)
+  {
+    game.Reset();
+    game.ClearBricks();
+    game.AddBrick(100, 100, 100, 50, 0xFF00FFFF);
+    game.BuildGrid();
+
+    // Center at (92, 92), 11.31 from the corner at (100, 100)
+    game.ball.radius = 10;
+    game.ball.pos_x = 82;
+    game.ball.pos_y = 82;
+    game.ball.speed_x = moves[k][0] * game.tick_rate;
+    game.ball.speed_y = moves[k][1] * game.tick_rate;
+    game.directionX = 1;
+    game.directionY = 1;
+
+    game.Step(input);
+
+    printf("moving (%g, %g): brick %s, direction (%d, %d)\n", moves[k][0], moves[k][1],
+           game.bricks.Alive(0) ? "standing" : "hit", game.directionX, game.directionY);
+    if (game.bricks.Alive(0) == hits[k] || (!hits[k] && (game.directionX != 1 || game.directionY != 1)))
+      failed++;
+  }
+
+  printf("%s\n", failed == 0 ? "Corner checks passed" : "Corner checks FAILED");
+
+  return failed == 0 ? 0 : 1;
+}
+
+// Collision cost per tick as the level grows. With the grid only the
+// cells along the ball's path are looked at, so it should stay flat
+static int BenchGrid(long long ticks)
+{
+  static const int counts[] = { 4, 100, 1000, 10000, 100000 };
+  Game game;
+  GameInput input;
+  long long t;
+  size_t k;
+  double seconds;
+
+  input.move = 0;
+  input.spawn = 0;
+
+  for (k = 0; k < sizeof(counts) / sizeof(counts[0]); k++)
+  {
+    BuildWall(game, counts[k]);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (t = 0; t < ticks && game.result == Game::PLAYING; t++)
+      game.Step(input);
+
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%7d bricks: %lld ticks, %.1f ns per tick, %d bricks hit\n", counts[k], t,
+           t > 0 ? seconds * 1e9 / t : 0.0, game.bricks.Count() - game.bricks.Remaining());
+  }
+
+  return 0;
+}
+
+// The brick test as my_callbackfunc wrote it, one struct per brick
+struct OldBrick
+{
+  int pos_x;
+  int pos_y;
+  int hight;
+  int weight;
+  bool print;
+};
+
+static int OverlapOld(const std::vector<OldBrick>& R, int x0, int y0, int x1, int y1, int* out)
+{
+  int i, n = 0;
+
+  for (i = 0; i < (int)R.size(); i++)
+    if (R[i].print == true && y0 < R[i].pos_y + R[i].hight && y1 > R[i].pos_y &&
+        x0 < R[i].pos_x + R[i].weight && x1 > R[i].pos_x)
+      out[n++] = i;
+
+  return n;
+}
+
+// Ball box against every brick: the old array of structs loop and the
+// BrickSoA kernels, in nanoseconds per brick tested
+static int BenchKernel()
+{
+  static const int counts[] = { 4, 64, 1000, 10000, 100000, 1000000 };
+  static const char* names[] = { "scalar", "sse2", "avx2" };
+  int detected = BrickSoA::DetectKernel();
+  BrickSoA bricks;
+  std::vector<OldBrick> old;
+  std::vector<int> out;
+  std::vector<int> boxes;
+  int columns, width, height, queries, q, i, kernel;
+  long long hits, expected;
+  unsigned seed;
+  size_t k;
+  double seconds;
+
+  printf("%8s %10s", "bricks", "old loop");
+  for (kernel = 0; kernel <= detected; kernel++)
+    printf(" %10s", names[kernel]);
+  printf("   (ns per brick)\n");
+
+  for (k = 0; k < sizeof(counts) / sizeof(counts[0]); k++)
+  {
+    columns = (int)ceil(sqrt(counts[k] * 3.0));
+    width = columns * 32;
+    height = (counts[k] + columns - 1) / columns * 14;
+    queries = (int)(50000000LL / counts[k]) + 1;
+    seed = 12345;
+
+    // A wall with about a quarter of the bricks already gone
+    bricks.Clear();
+    old.clear();
+    for (i = 0; i < counts[k]; i++)
+    {
+      OldBrick brick = { i % columns * 32, i / columns * 14, 12, 30, true };
+
+      seed = seed * 1103515245 + 12345;
+      brick.print = (seed >> 16) % 4 != 0;
+
+      bricks.Add(brick.pos_x, brick.pos_y, brick.weight, brick.hight, 0xFF00FFFF);
+      if (!brick.print)
+        bricks.Kill(i);
+      old.push_back(brick);
+    }
+    out.resize(counts[k]);
+
+    // Ball sized boxes anywhere over the wall
+    boxes.resize(queries * 2);
+    for (q = 0; q < queries; q++)
+    {
+      seed = seed * 1103515245 + 12345;
+      boxes[q * 2] = (int)((seed >> 8) % (unsigned)width);
+      seed = seed * 1103515245 + 12345;
+      boxes[q * 2 + 1] = (int)((seed >> 8) % (unsigned)(height + 1));
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    expected = 0;
+    for (q = 0; q < queries; q++)
+      expected += OverlapOld(old, boxes[q * 2], boxes[q * 2 + 1], boxes[q * 2] + 20, boxes[q * 2 + 1] + 20, out.data());
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%8d %10.3f", counts[k], seconds * 1e9 / ((double)queries * counts[k]));
+
+    for (kernel = 0; kernel <= detected; kernel++)
+    {
+      BrickSoA::SelectKernel(kernel);
+
+      start = std::chrono::steady_clock::now();
+      hits = 0;
+      for (q = 0; q < queries; q++)
+        hits += bricks.FindOverlaps(0, counts[k], boxes[q * 2], boxes[q * 2 + 1],
+                                    boxes[q * 2] + 20, boxes[q * 2 + 1] + 20, out.data());
+      seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      printf(" %10.3f%s", seconds * 1e9 / ((double)queries * counts[k]), hits == expected ? "" : "!");
+    }
+    printf("\n");
+  }
+
+  BrickSoA::SelectKernel(detected);
+  printf("! marks a kernel that disagreed with the old loop\n");
+
+  return 0;
+}
+
+// Mapped, or read with stdio where mapping fails
+static std::shared_ptr<LevelFile> OpenLevel(const char* path)
+{
+  std::shared_ptr<LevelFile> file = std::make_shared<LevelFile>();
+
+  if (!file->Map(path) && !file->Read(path))
+    return NULL;
+
+  return file;
+}
+
+// Time to get a big level ready to play: mapped and used in place, with
+// and without the checksum, read into memory, and added brick by brick
+static int BenchLevel(int count, const char* path)
+{
+  const int runs = 100;
+  int columns = 1000;
+  BrickSoA bricks, built;
+  static const char* names[] = { "map", "map + full check", "read", "add one by one" };
+  const char* error;
+  int i, run, mode;
+  double seconds;
+
+  for (i = 0; i < count; i++)
+    bricks.Add(10 + i % columns * 32, 10 + i / columns * 14, 30, 12, 0xFF00FFFF);
+
+  error = WriteLevel(path, bricks, columns * 32 + 20, (count + columns - 1) / columns * 14 + 420);
+  if (error != NULL)
+  {
+    printf("%s: %s\n", path, error);
+    return 1;
+  }
+
+  printf("%d bricks, %s\n", count, path);
+
+  for (mode = 0; mode < 4; mode++)
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (run = 0; run < runs; run++)
+    {
+      std::shared_ptr<LevelFile> file = std::make_shared<LevelFile>();
+
+      if (mode == 3)
+      {
+        built.Clear();
+        for (i = 0; i < count; i++)
+          built.Add(bricks.pos_x[i], bricks.pos_y[i], bricks.weight[i], bricks.hight[i], bricks.color[i]);
+        continue;
+      }
+
+      error = NULL;
+      if (!(mode == 2 ? file->Read(path) : file->Map(path)) || (error = file->Check(mode == 1)) != NULL)
+      {
+        printf("%s: %s\n", path, error != NULL ? error : "cannot open it");
+        return 1;
+      }
+      UseLevel(file, built);
+    }
+
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // The last brick, so nothing above can be skipped
+    if (built.Count() != count || built.pos_x[count - 1] != bricks.pos_x[count - 1])
+    {
+      printf("%s: level came back wrong\n", names[mode]);
+      return 1;
+    }
+
+    printf("%16s: %9.3f ms per load\n", names[mode], seconds * 1000 / runs);
+  }
+
+  return 0;
+}
+
+// Fingerprint of a level, equal on every machine for the same bricks
+static uint64_t BrickHash(const BrickSoA& bricks)
+{
+  uint64_t hash = 0xCBF29CE484222325ull;
+  int i;
+
+  for (i = 0; i < bricks.Count(); i++)
+  {
+    hash = (hash ^ ((uint64_t)(uint32_t)bricks.pos_x[i] << 32 | (uint32_t)bricks.pos_y[i])) * 0x100000001B3ull;
+    hash = (hash ^ ((uint64_t)(uint32_t)bricks.weight[i] << 32 | (uint32_t)bricks.hight[i])) * 0x100000001B3ull;
+    hash = (hash ^ bricks.color[i]) * 0x100000001B3ull;
+  }
+
+  return hash;
+}
+
+// Every pattern on one thread and on all of them: the time, and that the
+// bricks come out the same either way
+static int BenchGenerate(int columns, int rows)
+{
+  LevelGenerator generator;
+  BrickSoA bricks;
+  uint64_t hash[2];
+  double seconds[2];
+  int pattern, run, failed = 0;
+  int threads = std::max(2, (int)std::thread::hardware_concurrency());  // Threaded even on one core
+
+  generator.seed = 2024;
+  generator.columns = columns;
+  generator.rows = rows;
+
+  printf("%d x %d cells, seed %llu\n", columns, rows, (unsigned long long)generator.seed);
+
+  for (pattern = LevelGenerator::GRID; pattern <= LevelGenerator::RANDOM_SIZES; pattern++)
+  {
+    generator.pattern = pattern;
+
+    for (run = 0; run < 2; run++)
+    {
+      generator.threads = run == 0 ? 1 : threads;
+
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      generator.Generate(bricks);
+      seconds[run] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      hash[run] = BrickHash(bricks);
+    }
+
+    printf("%6s: %9d bricks, %8.2f ms on 1 thread, %8.2f ms on %d, hash %016llx%s\n",
+           LevelGenerator::PatternName(pattern), bricks.Count(), seconds[0] * 1000, seconds[1] * 1000, threads,
+           (unsigned long long)hash[1], hash[0] == hash[1] ? "" : " DIFFERENT");
+    failed += hash[0] != hash[1];
+  }
+
+  return failed == 0 ? 0 : 1;
+}
+
+// Extra balls in a 1280 x 720 field: the pool's integrate kernels alone,
+// then whole ticks with the paddle and brick checks. The only brick is
+// one no ball can reach, so the game never ends
+static int BenchBalls()
+{
+  static const int counts[] = { 1000, 10000, 100000, 1000000 };
+  static const char* names[] = { "scalar", "sse2", "avx2" };
+  int detected = BrickSoA::DetectKernel();
+  Game game;
+  GameInput input;
+  BallPool start;
+  Xoshiro256 random(7);
+  long long ticks, t, ball_ticks;
+  double seconds, per_ball, frame_ticks;
+  size_t k;
+  int i, kernel;
+
+  input.move = 0;
+  input.spawn = 0;
+
+  printf("%8s", "balls");
+  for (kernel = 0; kernel <= detected; kernel++)
+    printf(" %8s", names[kernel]);
+  printf(" %8s   (ns per ball per tick)   balls in a 60 Hz frame\n", "tick");
+
+  for (k = 0; k < sizeof(counts) / sizeof(counts[0]); k++)
+  {
+    game.Reset();
+    game.width = 1280;
+    game.height = 720;
+    game.ClearBricks();
+    game.AddBrick(-100, -100, 10, 10, 0xFF00FFFF);
+    game.BuildGrid();
+    game.paddle.pos_x = 0;
+    game.paddle.pos_y = game.height - 50.0f;
+    game.paddle.weight = game.width;
+    game.ball.pos_x = 630;
+    game.ball.pos_y = 400;
+
+    game.balls.Reserve(counts[k]);
+    for (i = 0; i < counts[k]; i++)
+      game.balls.Spawn((float)random.Below(1260), (float)random.Below(600),
+                       (float)random.Below(800) - 400, (float)random.Below(800) - 400, 10);
+    start.CopyFrom(game.balls);
+
+    ticks = std::max(20LL, 20000000LL / counts[k]);
+    printf("%8d", counts[k]);
+
+    // Nothing to fall out of, so every kernel moves the same balls
+    for (kernel = 0; kernel <= detected; kernel++)
+    {
+      BrickSoA::SelectKernel(kernel);
+      game.balls.CopyFrom(start);
+
+      std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+      for (t = 0; t < ticks; t++)
+        game.balls.Integrate(game.tick_seconds, (float)game.width, 1e9f);
+      seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+      printf(" %8.3f", seconds * 1e9 / ((double)ticks * counts[k]));
+    }
+
+    BrickSoA::SelectKernel(detected);
+    game.balls.CopyFrom(start);
+    ball_ticks = 0;
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (t = 0; t < ticks && game.result == Game::PLAYING; t++)
+    {
+      ball_ticks += game.balls.Count();
+      game.Step(input);
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    // Ticks the simulation runs per 60 Hz frame
+    per_ball = ball_ticks > 0 ? seconds * 1e9 / ball_ticks : 0.0;
+    frame_ticks = game.tick_rate / 60.0;
+    printf(" %8.3f   %30.0f\n", per_ball, per_ball > 0 ? 1e9 / 60 / frame_ticks / per_ball : 0.0);
+  }
+
+  return 0;
+}
+
+// Update cost per kernel, then a whole 10k brick level going in one frame
+static int BenchParticles()
+{
+  static const char* names[] = { "scalar", "sse2", "avx2" };
+  int detected = BrickSoA::DetectKernel();
+  ParticlePool particles;
+  LevelGenerator generator;
+  BrickSoA bricks;
+  std::vector<uint64_t> seen;
+  Xoshiro256 random(11);
+  double seconds, worst = 0, total = 0;
+  int i, kernel, frame, most = 0, emitted = 0, dropped = 0;
+  const int updates = 2000;
+
+  // Full ring that never expires, so every kernel moves the same particles
+  particles.Reserve(65536);
+  particles.frame_budget = particles.Capacity();
+  particles.lifetime = 1e9f;
+  particles.BeginFrame();
+  for (i = 0; i < particles.Capacity(); i++)
+    particles.Emit((float)random.Below(1280), (float)random.Below(720),
+                   (float)random.Below(400) - 200, (float)random.Below(400) - 200, 0xFFFFFFFF);
+
+  printf("%d particles:", particles.Count());
+  for (kernel = 0; kernel <= detected; kernel++)
+  {
+    BrickSoA::SelectKernel(kernel);
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (i = 0; i < updates; i++)
+      particles.Update(1.0f / 60);
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    printf(" %s %.3f ns", names[kernel], seconds * 1e9 / ((double)updates * particles.Count()));
+  }
+  printf(" per particle per update\n");
+  BrickSoA::SelectKernel(detected);
+
+  // The game's settings
+  particles = ParticlePool();
+  particles.Reserve(65536);
+  particles.frame_budget = 4096;
+
+  generator.columns = 100;
+  generator.rows = 100;
+  generator.Generate(bricks);
+  seen = bricks.live;
+  for (i = 0; i < bricks.Count(); i++)
+    bricks.Kill(i);
+
+  for (frame = 0; frame < 60; frame++)
+  {
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    particles.BeginFrame();
+    particles.EmitDeaths(bricks, seen);
+    particles.Update(1.0f / 60);
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    worst = std::max(worst, seconds);
+    total += seconds;
+    most = std::max(most, particles.Count());
+    emitted += particles.emitted;
+    dropped += particles.dropped;
+  }
+
+  printf("%d bricks at once: %d particles emitted, %d dropped, %d alive at most, "
+         "emit and update %.1f us worst frame, %.1f us average\n",
+         bricks.Count(), emitted, dropped, most, worst * 1e6, total * 1e6 / 60);
+
+  return 0;
+}
+
+// One game of the simple player, recorded
+static int Record(Game& game, const char* path, long long max_ticks)
+{
+  ReplayRecorder recorder;
+  GameInput input;
+  const char* error;
+
+  game.Reset();
+  recorder.Start(game, 60);
+
+  while (game.result == Game::PLAYING && game.ticks < max_ticks)
+  {
+    input = FollowBall(game);
+    game.Step(input);
+    recorder.Record(input, game);
+  }
+
+  error = recorder.Write(path);
+  if (error != NULL)
+  {
+    printf("%s: %s\n", path, error);
+    return 1;
+  }
+
+  printf("%lld ticks recorded to %s\n", recorder.Ticks(), path);
+  return 0;
+}
+
+// A recorded session played again as fast as it goes, checking every
+// checkpoint on the way. Played many times it is a benchmark on real play
+static int Replay(Game& game, const char* path, int times)
+{
+  ReplayLog log;
+  const char* error = log.Read(path);
+  uint32_t level = game.Level() ? game.Level()->Header().checksum : 0;
+  long long differs;
+  double seconds;
+  int k;
+
+  if (error != NULL)
+  {
+    printf("%s: %s\n", path, error);
+    return 1;
+  }
+
+  if (log.header.level != level)
+  {
+    printf("%s was recorded on another level, checksum %08x\n", path, log.header.level);
+    return 1;
+  }
+
+  // Same kernel as the recording, the extra balls must move the same
+  if ((int)log.header.kernel <= BrickSoA::DetectKernel())
+    BrickSoA::SelectKernel((int)log.header.kernel);
+  else
+    printf("Recorded with brick kernel %u, this CPU lacks it\n", log.header.kernel);
+
+  game.SetTickRate((int)log.header.tick_rate);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  for (k = 0; k < times; k++)
+  {
+    game.Reset();
+    differs = log.Play(game);
+    if (differs >= 0)
+    {
+      printf("%s: replay differs in ticks %lld .. %lld\n", path, differs,
+             differs + (long long)log.header.hash_interval - 1);
+      return 1;
+    }
+  }
+
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("%s: %llu ticks, %llu input bytes, %s, every checkpoint matches\n", path,
+         (unsigned long long)log.header.ticks, (unsigned long long)log.header.input_bytes,
+         game.result == Game::WIN ? "won" : game.result == Game::LOSE ? "lost" : "still playing");
+  printf("%d replays in %.3f s, %.0f ticks per second\n", times, seconds,
+         seconds > 0 ? times * (double)log.header.ticks / seconds : 0.0);
+
+  return 0;
+}
+
+// The same batch of games on 1, 2, 4 ... threads up to the given count,
+// then what the games came to
+static int Batch(std::shared_ptr<const LevelFile> level, int games, int threads, long long max_ticks)
+{
+  BatchRunner batch;
+  std::vector<BatchResult, AlignedAllocator<BatchResult, 64> > first;
+  double base = 0, rate;
+  bool same = true;
+  int n, i;
+
+  batch.games = games;
+  batch.max_ticks = max_ticks;
+  batch.level = level;
+  batch.player = FollowBall;
+
+  threads = threads > 0 ? threads : (int)std::max(1u, std::thread::hardware_concurrency());
+
+  printf("%8s %12s %8s %10s %8s\n", "threads", "games/s", "speedup", "efficiency", "steals");
+
+  for (n = 1; ; n = std::min(n * 2, threads))
+  {
+    const char* error = batch.Run(n);
+
+    if (error != NULL)
+    {
+      printf("Level: %s\n", error);
+      return 1;
+    }
+
+    rate = batch.seconds > 0 ? games / batch.seconds : 0.0;
+    if (n == 1)
+    {
+      base = rate;
+      first = batch.Results();
+    }
+    for (i = 0; i < games; i++)
+      same = same && batch.Results()[i].ticks == first[i].ticks && batch.Results()[i].result == first[i].result;
+
+    printf("%8d %12.0f %8.2f %9.0f%% %8lld\n", n, rate, base > 0 ? rate / base : 0.0,
+           base > 0 ? 100.0 * rate / base / n : 0.0, batch.steals);
+
+    if (n == threads)
+      break;
+  }
+
+  printf("%d games: %.1f%% won, %d lost, %d timed out, %.0f ticks to clear on average\n", games,
+         100.0 * batch.wins / games, batch.losses, batch.timeouts,
+         batch.wins > 0 ? (double)batch.ticks_to_clear / batch.wins : 0.0);
+  printf("%lld ticks, %.3f bricks per simulated second, %.0f ticks per second on %d threads\n",
+         batch.ticks, batch.ticks > 0 ? (double)batch.bricks * batch.tick_rate / batch.ticks : 0.0,
+         batch.seconds > 0 ? batch.ticks / batch.seconds : 0.0, threads);
+  printf("Results %s on every thread count\n", same ? "identical" : "DIFFER");
+
+  return same ? 0 : 1;
+}
+
+// The vectorized environment driven the way a trainer would, with the
+// actions worked out from the observations between steps
+static int BenchEnv(std::shared_ptr<const LevelFile> level, int count, int threads, int steps)
+{
+  VecEnv env(count, threads);
+  std::vector<float> observations((size_t)count * VecEnv::OBSERVATION_SIZE);
+  std::vector<float> rewards(count);
+  std::vector<uint8_t> dones(count);
+  std::vector<int> actions(count);
+  const float* obs;
+  double seconds, reward = 0;
+  long long episodes = 0;
+  int s, i;
+
+  if (level)
+  {
+    const char* error = env.SetLevel(level);
+
+    if (error != NULL)
+    {
+      printf("Level: %s\n", error);
+      return 1;
+    }
+  }
+
+  BrickSoA::SelectKernel(BrickSoA::DetectKernel());
+  env.Reset(1, observations.data());
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  for (s = 0; s < steps; s++)
+  {
+    // Paddle middle towards the ball
+    for (i = 0; i < count; i++)
+    {
+      obs = &observations[(size_t)i * VecEnv::OBSERVATION_SIZE];
+      actions[i] = obs[0] < obs[4] - 0.01f ? -1 : obs[0] > obs[4] + 0.01f ? 1 : 0;
+    }
+
+    env.Step(actions.data(), observations.data(), rewards.data(), dones.data());
+
+    for (i = 0; i < count; i++)
+    {
+      reward += rewards[i];
+      episodes += dones[i];
+    }
+  }
+
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("%d games x %d steps on %d threads: %.3f s, %.0f env steps per second\n", count, steps,
+         env.Threads(), seconds, seconds > 0 ? (double)count * steps / seconds : 0.0);
+  printf("%lld games finished, %.4f reward per step\n", episodes, reward / ((double)count * steps));
+
+  return 0;
+}
+
+// The classic rules stepped one game at a time and then 4 and 8 games per
+// register, from the same seed, in blocks on a work stealing pool of one
+// thread and of many. Every game has to end in the same state whichever
+// way it was stepped
+static int BenchWide(const Game& game, std::shared_ptr<const LevelFile> level, int count, int ticks, int threads)
+{
+  static const char* names[] = { "scalar", "sse2", "avx2" };
+  int detected = BrickSoA::DetectKernel();
+  ClassicGames classic(count);
+  WorkStealingPool one(1), all(threads);
+  WorkStealingPool* pools[2] = { &one, &all };
+  std::vector<uint64_t> hashes(count);
+  long long played = 0;
+  int wins = 0, losses = 0, kernel, run, g;
+  double seconds, rate, base = 0;
+  bool same = true, row_same;
+
+  if (level && !classic.UseBricks(game.bricks, game.width, game.height))
+  {
+    printf("--bench-wide takes levels of up to %d bricks\n", (int)ClassicGames::MAX_BRICKS);
+    return 1;
+  }
+
+  printf("%8s %8s %14s %8s %8s\n", "kernel", "threads", "game ticks/s", "speedup", "states");
+
+  // Every kernel through the same pool path on the same seed, on one
+  // thread and then on all. Speedup is over scalar on as many threads,
+  // states are checked against scalar on one
+  for (run = 0; run < 2; run++)
+    for (kernel = 0; kernel <= detected; kernel++)
+    {
+      classic.Reset(1);
+
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      classic.Step(*pools[run], kernel, ticks);
+      seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      played = 0;
+      wins = 0;
+      losses = 0;
+      row_same = true;
+      for (g = 0; g < count; g++)
+      {
+        played += classic.ticks[g];
+        wins += classic.result[g] == ClassicGames::WIN;
+        losses += classic.result[g] == ClassicGames::LOSE;
+        if (run == 0 && kernel == 0)
+          hashes[g] = classic.Hash(g);
+        else if (hashes[g] != classic.Hash(g))
+          row_same = false;
+      }
+      same = same && row_same;
+
+      rate = seconds > 0 ? played / seconds : 0.0;
+      if (kernel == 0)
+        base = rate;
+      printf("%8s %8d %14.0f %8.2f %8s\n", names[kernel], pools[run]->Threads(), rate, base > 0 ? rate / base : 0.0,
+             run == 0 && kernel == 0 ? "ref" : row_same ? "same" : "DIFFER");
+    }
+
+  printf("%d games: %d won, %d lost, %d still playing, %lld ticks\n", count, wins, losses,
+         count - wins - losses, played);
+  printf("Per game states %s on every kernel and thread count\n", same ? "identical" : "DIFFER");
+
+  return same ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+  Game game;
+  int games = 1000;
+  long long max_ticks = 100000;
+  int g;
+  int wins = 0, losses = 0, timeouts = 0;
+  long long ticks = 0;
+  double seconds;
+  float speed = 0;  // Ball speed in pixels per second, 0 keeps the default
+  std::shared_ptr<LevelFile> level;  // From --level
+
+  if (argc > 1 && strcmp(argv[1], "--handoff") == 0)
+    return Handoff(argc > 2 ? atoll(argv[2]) : 10000000);
+
+  if (argc > 1 && strcmp(argv[1], "--check-corner") == 0)
+    return CheckCorner();
+
+  if (argc > 1 && strcmp(argv[1], "--bench-kernel") == 0)
+    return BenchKernel();
+
+  if (argc > 1 && strcmp(argv[1], "--bench-grid") == 0)
+    return BenchGrid(argc > 2 ? atoll(argv[2]) : 1000000);
+
+  if (argc > 1 && strcmp(argv[1], "--bench-level") == 0)
+    return BenchLevel(argc > 2 ? atoi(argv[2]) : 1000000, argc > 3 ? argv[3] : "bench.lvl");
+
+  if (argc > 1 && strcmp(argv[1], "--bench-balls") == 0)
+    return BenchBalls();
+
+  if (argc > 1 && strcmp(argv[1], "--bench-particles") == 0)
+    return BenchParticles();
+
+  if (argc > 1 && strcmp(argv[1], "--bench-generate") == 0)
+    return BenchGenerate(argc > 2 ? atoi(argv[2]) : 2000, argc > 3 ? atoi(argv[3]) : 1000);
+
+  if (argc > 6 && strcmp(argv[1], "--generate") == 0)
+  {
+    LevelGenerator generator;
+    BrickSoA bricks;
+    const char* error;
+
+    generator.pattern = LevelGenerator::PatternFromName(argv[2]);
+    generator.seed = strtoull(argv[3], NULL, 10);
+    generator.columns = atoi(argv[4]);
+    generator.rows = atoi(argv[5]);
+    if (generator.pattern < 0 || generator.columns <= 0 || generator.rows <= 0)
+    {
+      printf("--generate grid|noise|maze|sizes seed columns rows level.bin\n");
+      return 1;
+    }
+
+    error = generator.Generate(bricks);
+    if (error != NULL)
+    {
+      printf("--generate: %s\n", error);
+      return 1;
+    }
+
+    error = WriteLevel(argv[6], bricks, generator.Width(), generator.Height());
+    if (error != NULL)
+    {
+      printf("%s: %s\n", argv[6], error);
+      return 1;
+    }
+
+    printf("%d bricks, hash %016llx\n", bricks.Count(), (unsigned long long)BrickHash(bricks));
+    return 0;
+  }
+
+  if (argc > 3 && strcmp(argv[1], "--convert") == 0)
+  {
+    char message[128];
+    const char* error = ConvertLevel(argv[2], argv[3], message, sizeof(message));
+
+    if (error != NULL)
+    {
+      printf("%s: %s\n", argv[2], error);
+      return 1;
+    }
+    return 0;
+  }
+
+  if (argc > 2 && strcmp(argv[1], "--level") == 0)
+  {
+    const char* error;
+
+    level = OpenLevel(argv[2]);
+    error = level ? game.SetLevel(level) : "cannot open it";
+
+    if (error != NULL)
+    {
+      printf("%s: %s\n", argv[2], error);
+      return 1;
+    }
+    argc -= 2;
+    argv += 2;
+  }
+
+  if (argc > 2 && strcmp(argv[1], "--record") == 0)
+    return Record(game, argv[2], argc > 3 ? atoll(argv[3]) : max_ticks);
+
+  if (argc > 1 && strcmp(argv[1], "--batch") == 0)
+    return Batch(level, argc > 2 ? atoi(argv[2]) : 10000, argc > 3 ? atoi(argv[3]) : 0,
+                 argc > 4 ? atoll(argv[4]) : 20000);
+
+  if (argc > 1 && strcmp(argv[1], "--bench-env") == 0)
+    return BenchEnv(level, argc > 2 ? atoi(argv[2]) : 4096, argc > 3 ? atoi(argv[3]) : 0,
+                    argc > 4 ? atoi(argv[4]) : 2000);
+
+  if (argc > 1 && strcmp(argv[1], "--bench-wide") == 0)
+    return BenchWide(game, level, argc > 2 ? atoi(argv[2]) : 65536, argc > 3 ? atoi(argv[3]) : 20000,
+                     argc > 4 ? atoi(argv[4]) : 0);
+
+  if (argc > 2 && strcmp(argv[1], "--replay") == 0)
+    return Replay(game, argv[2], argc > 3 ? atoi(argv[3]) : 1);
+
+  if (argc > 1)
+    games = atoi(argv[1]);
+  if (argc > 2)
+    max_ticks = atoll(argv[2]);
+  if (argc > 3 && atoi(argv[3]) > 0)
+    game.SetTickRate(atoi(argv[3]));
+  if (argc > 4 && atof(argv[4]) > 0)
+    speed = (float)atof(argv[4]);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  for (g = 0; g < games; g++)
+  {
+    game.Reset();
+    if (speed > 0)
+    {
+      game.ball.speed_x = speed;
+      game.ball.speed_y = speed;
+    }
+
+    while (game.result == Game::PLAYING && game.ticks < max_ticks)
+      game.Step(FollowBall(game));
+
+    ticks += game.ticks;
+    if (game.result == Game::WIN)
+      wins++;
+    else if (game.result == Game::LOSE)
+      losses++;
+    else
+      timeouts++;
+  }
+
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("games %d: %d won, %d lost, %d timed out\n", games, wins, losses, timeouts);
+  printf("%lld ticks in %.3f s, %.0f ticks per second\n", ticks, seconds,
+         seconds > 0 ? ticks / seconds : 0.0);
+
+  return 0;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+// VecEnv for C and anything with a C foreign function interface, see
+// Env.h for what Reset and Step fill. No exception gets out of these.
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ArkEnv ArkEnv;
+
+// level_path NULL for the classic level. NULL when the level can't be
+// used or memory runs out
+ArkEnv* ArkEnvCreate(int count, int threads, const char* level_path);
+int ArkEnvObservationSize(void);
+void ArkEnvReset(ArkEnv* env, uint64_t seed, float* observations);
+void ArkEnvStep(ArkEnv* env, const int* actions, float* observations, float* rewards, uint8_t* dones);
+void ArkEnvDestroy(ArkEnv* env);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,233 @@
+#include "Balls.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "Bits.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define BALLS_X86
+#include <immintrin.h>
+#endif
+
+// Each kernel moves balls [first, last), folds them back off the walls and
+// writes the index of every ball that reached the bottom to fallen.
+// Reflection without branches: past the left wall x becomes -x, past the
+// right one right - (x - right), which is right - |right - |x||
+static int IntegrateScalar(BallPool& balls, int first, int last, float seconds,
+                           float width, float height, int* fallen)
+{
+  float* pos_x = balls.pos_x.data();
+  float* pos_y = balls.pos_y.data();
+  float* speed_x = balls.speed_x.data();
+  float* speed_y = balls.speed_y.data();
+  const float* radius = balls.radius.data();
+  float x, y, right;
+  int i, n = 0;
+
+  for (i = first; i < last; i++)
+  {
+    x = pos_x[i] + speed_x[i] * seconds;
+    y = pos_y[i] + speed_y[i] * seconds;
+    right = width - 2 * radius[i];
+
+    if (x < 0)
+      speed_x[i] = fabsf(speed_x[i]);
+    else if (x > right)
+      speed_x[i] = -fabsf(speed_x[i]);
+    if (y < 0)
+      speed_y[i] = fabsf(speed_y[i]);
+
+    pos_x[i] = right - fabsf(right - fabsf(x));
+    pos_y[i] = fabsf(y);
+
+    fallen[n] = i;
+    n += pos_y[i] + 2 * radius[i] >= height;
+  }
+
+  return n;
+}
+
+#ifdef BALLS_X86
+
+TARGET_SSE2
+static int IntegrateSSE2(BallPool& balls, int first, int last, float seconds,
+                         float width, float height, int* fallen)
+{
+  float* pos_x = balls.pos_x.data();
+  float* pos_y = balls.pos_y.data();
+  float* speed_x = balls.speed_x.data();
+  float* speed_y = balls.speed_y.data();
+  const float* radius = balls.radius.data();
+  const __m128 dt = _mm_set1_ps(seconds);
+  const __m128 vwidth = _mm_set1_ps(width);
+  const __m128 vheight = _mm_set1_ps(height);
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  const __m128 zero = _mm_setzero_ps();
+  __m128 x, y, vx, vy, diameter, right, left_hit, right_hit, top_hit;
+  int i = first, n = 0, mask;
+
+  // Four balls per step
+  for (; i + 4 <= last; i += 4)
+  {
+    vx = _mm_loadu_ps(speed_x + i);
+    vy = _mm_loadu_ps(speed_y + i);
+    x = _mm_add_ps(_mm_loadu_ps(pos_x + i), _mm_mul_ps(vx, dt));
+    y = _mm_add_ps(_mm_loadu_ps(pos_y + i), _mm_mul_ps(vy, dt));
+    diameter = _mm_add_ps(_mm_loadu_ps(radius + i), _mm_loadu_ps(radius + i));
+    right = _mm_sub_ps(vwidth, diameter);
+
+    left_hit = _mm_cmplt_ps(x, zero);
+    right_hit = _mm_cmpgt_ps(x, right);
+    top_hit = _mm_cmplt_ps(y, zero);
+
+    // |v| where a wall sends the ball right or down, -|v| for the right wall
+    vx = _mm_or_ps(_mm_andnot_ps(_mm_or_ps(left_hit, right_hit), vx),
+                   _mm_and_ps(_mm_or_ps(left_hit, right_hit),
+                              _mm_or_ps(_mm_andnot_ps(sign, vx), _mm_and_ps(right_hit, sign))));
+    vy = _mm_or_ps(_mm_andnot_ps(top_hit, vy), _mm_and_ps(top_hit, _mm_andnot_ps(sign, vy)));
+
+    x = _mm_sub_ps(right, _mm_andnot_ps(sign, _mm_sub_ps(right, _mm_andnot_ps(sign, x))));
+    y = _mm_andnot_ps(sign, y);
+
+    _mm_storeu_ps(pos_x + i, x);
+    _mm_storeu_ps(pos_y + i, y);
+    _mm_storeu_ps(speed_x + i, vx);
+    _mm_storeu_ps(speed_y + i, vy);
+
+    for (mask = _mm_movemask_ps(_mm_cmpge_ps(_mm_add_ps(y, diameter), vheight)); mask != 0; mask &= mask - 1)
+      fallen[n++] = i + CountTrailingZeros((uint32_t)mask);
+  }
+
+  return n + IntegrateScalar(balls, i, last, seconds, width, height, fallen + n);
+}
+
+TARGET_AVX2
+static int IntegrateAVX2(BallPool& balls, int first, int last, float seconds,
+                         float width, float height, int* fallen)
+{
+  float* pos_x = balls.pos_x.data();
+  float* pos_y = balls.pos_y.data();
+  float* speed_x = balls.speed_x.data();
+  float* speed_y = balls.speed_y.data();
+  const float* radius = balls.radius.data();
+  const __m256 dt = _mm256_set1_ps(seconds);
+  const __m256 vwidth = _mm256_set1_ps(width);
+  const __m256 vheight = _mm256_set1_ps(height);
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  const __m256 zero = _mm256_setzero_ps();
+  __m256 x, y, vx, vy, diameter, right, left_hit, right_hit, top_hit, wall;
+  int i = first, n = 0, mask;
+
+  // Eight balls per step
+  for (; i + 8 <= last; i += 8)
+  {
+    vx = _mm256_loadu_ps(speed_x + i);
+    vy = _mm256_loadu_ps(speed_y + i);
+    x = _mm256_add_ps(_mm256_loadu_ps(pos_x + i), _mm256_mul_ps(vx, dt));
+    y = _mm256_add_ps(_mm256_loadu_ps(pos_y + i), _mm256_mul_ps(vy, dt));
+    diameter = _mm256_add_ps(_mm256_loadu_ps(radius + i), _mm256_loadu_ps(radius + i));
+    right = _mm256_sub_ps(vwidth, diameter);
+
+    left_hit = _mm256_cmp_ps(x, zero, _CMP_LT_OQ);
+    right_hit = _mm256_cmp_ps(x, right, _CMP_GT_OQ);
+    top_hit = _mm256_cmp_ps(y, zero, _CMP_LT_OQ);
+    wall = _mm256_or_ps(left_hit, right_hit);
+
+    vx = _mm256_blendv_ps(vx, _mm256_or_ps(_mm256_andnot_ps(sign, vx), _mm256_and_ps(right_hit, sign)), wall);
+    vy = _mm256_blendv_ps(vy, _mm256_andnot_ps(sign, vy), top_hit);
+
+    x = _mm256_sub_ps(right, _mm256_andnot_ps(sign, _mm256_sub_ps(right, _mm256_andnot_ps(sign, x))));
+    y = _mm256_andnot_ps(sign, y);
+
+    _mm256_storeu_ps(pos_x + i, x);
+    _mm256_storeu_ps(pos_y + i, y);
+    _mm256_storeu_ps(speed_x + i, vx);
+    _mm256_storeu_ps(speed_y + i, vy);
+
+    mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_add_ps(y, diameter), vheight, _CMP_GE_OQ));
+    for (; mask != 0; mask &= mask - 1)
+      fallen[n++] = i + CountTrailingZeros((uint32_t)mask);
+  }
+
+  _mm256_zeroupper();
+
+  return n + IntegrateScalar(balls, i, last, seconds, width, height, fallen + n);
+}
+
+#endif
+
+BallPool::BallPool()
+{
+  count = 0;
+  capacity = 0;
+}
+
+void BallPool::Reserve(int n)
+{
+  count = 0;
+  capacity = n;
+  pos_x.assign(n, 0.0f);
+  pos_y.assign(n, 0.0f);
+  speed_x.assign(n, 0.0f);
+  speed_y.assign(n, 0.0f);
+  radius.assign(n, 0.0f);
+  fallen.assign(n, 0);
+}
+
+bool BallPool::Spawn(float x, float y, float vx, float vy, float r)
+{
+  if (count == capacity)
+    return false;
+
+  pos_x[count] = x;
+  pos_y[count] = y;
+  speed_x[count] = vx;
+  speed_y[count] = vy;
+  radius[count] = r;
+  count++;
+
+  return true;
+}
+
+void BallPool::CopyFrom(const BallPool& other)
+{
+  if (capacity != other.capacity)
+    Reserve(other.capacity);
+
+  count = other.count;
+  if (count == 0)
+    return;
+
+  memcpy(pos_x.data(), other.pos_x.data(), count * sizeof(float));
+  memcpy(pos_y.data(), other.pos_y.data(), count * sizeof(float));
+  memcpy(speed_x.data(), other.speed_x.data(), count * sizeof(float));
+  memcpy(speed_y.data(), other.speed_y.data(), count * sizeof(float));
+  memcpy(radius.data(), other.radius.data(), count * sizeof(float));
+}
+
+void BallPool::Integrate(float seconds, float width, float height)
+{
+  int n, k;
+
+  if (count == 0)
+    return;
+
+#ifdef BALLS_X86
+  if (BrickSoA::SelectedKernel() == BrickSoA::AVX2)
+    n = IntegrateAVX2(*this, 0, count, seconds, width, height, fallen.data());
+  else if (BrickSoA::SelectedKernel() == BrickSoA::SSE2)
+    n = IntegrateSSE2(*this, 0, count, seconds, width, height, fallen.data());
+  else
+#endif
+    n = IntegrateScalar(*this, 0, count, seconds, width, height, fallen.data());
+
+  // Highest first, so the last ball moved into a hole is never one that
+  // still has to go
+  for (k = n - 1; k >= 0; k--)
+    Kill(fallen[k]);
+}
+
+BallPool::~BallPool()
+{
+}
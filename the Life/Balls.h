@@ -0,0 +1,70 @@
+#pragma once
+
+// Extra balls, for power-ups and stress tests. Fixed capacity, allocated
+// once by Reserve: spawning never touches the heap and a full pool just
+// refuses. The balls are kept dense in [0, Count()), a dead ball is
+// replaced by the last one (swap and pop).
+//
+// Unlike Ball the speed is signed, the direction is in it. Positions are
+// the top left corner of the ball's box, as in Ball.
+
+#include <stdint.h>
+#include <vector>
+
+#include "Bricks.h"
+
+class BallPool
+{
+public:
+  std::vector<float, AlignedAllocator<float> > pos_x;
+  std::vector<float, AlignedAllocator<float> > pos_y;
+  std::vector<float, AlignedAllocator<float> > speed_x;  // Pixels per second
+  std::vector<float, AlignedAllocator<float> > speed_y;
+  std::vector<float, AlignedAllocator<float> > radius;
+
+  BallPool();
+
+  void Reserve(int capacity);  // Drops every ball
+
+  int Count() const
+  {
+    return count;
+  }
+
+  int Capacity() const
+  {
+    return capacity;
+  }
+
+  bool Spawn(float x, float y, float vx, float vy, float r);  // False when full
+
+  void Kill(int i)
+  {
+    count--;
+    pos_x[i] = pos_x[count];
+    pos_y[i] = pos_y[count];
+    speed_x[i] = speed_x[count];
+    speed_y[i] = speed_y[count];
+    radius[i] = radius[count];
+  }
+
+  void Clear()
+  {
+    count = 0;
+  }
+
+  // Same capacity and balls as other, copying only the live ones
+  void CopyFrom(const BallPool& other);
+
+  // Moves every ball for seconds, bouncing off the left, right and top
+  // walls of a width x height field. Balls that reach the bottom are
+  // removed. Runs on the kernel BrickSoA::SelectedKernel() names
+  void Integrate(float seconds, float width, float height);
+
+  ~BallPool();
+
+private:
+  int count;
+  int capacity;
+  std::vector<int> fallen;  // Scratch for Integrate, capacity entries
+};
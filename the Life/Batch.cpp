@@ -0,0 +1,127 @@
+#include "Batch.h"
+
+#include <chrono>
+#include <new>
+
+#include "Generator.h"
+
+// A worker's game, on cache lines no other worker writes
+struct alignas(64) BatchPlayer
+{
+  Game game;
+};
+
+BatchRunner::BatchRunner()
+{
+  games = 1000;
+  seed = 1;
+  max_ticks = 100000;
+  tick_rate = 120;
+  speed = 0;
+  player = NULL;
+  wins = 0;
+  losses = 0;
+  timeouts = 0;
+  ticks = 0;
+  ticks_to_clear = 0;
+  bricks = 0;
+  steals = 0;
+  seconds = 0;
+}
+
+const char* BatchRunner::Run(int threads)
+{
+  WorkStealingPool pool(threads);
+  AlignedAllocator<BatchPlayer, 64> allocator;
+  std::vector<BatchPlayer*> players(pool.Threads(), (BatchPlayer*)NULL);
+  const char* error = level ? level->Check(true) : NULL;
+  size_t k;
+  int i;
+
+  if (error != NULL)
+    return error;
+
+  results.assign(games, BatchResult());
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  pool.Run(games, [&](int index, int worker)
+  {
+    BatchResult& out = results[index];
+    Xoshiro256 random(seed, (uint64_t)index);
+    GameInput input;
+    int before;
+
+    // Made by the worker itself, so its memory is first touched there
+    if (players[worker] == NULL)
+    {
+      players[worker] = new (allocator.allocate(1)) BatchPlayer;
+      players[worker]->game.SetTickRate(tick_rate);
+      if (level)
+        players[worker]->game.SetLevel(level, false);  // Checked above
+    }
+
+    Game& game = players[worker]->game;
+
+    game.Reset();
+    if (speed > 0)
+    {
+      game.ball.speed_x = speed;
+      game.ball.speed_y = speed;
+    }
+
+    // Up to 100 pixels either way, either direction
+    game.ball.pos_x += (float)random.Below(201) - 100;
+    if (random.Below(2) == 0)
+      game.directionX = -game.directionX;
+
+    input.move = 0;
+    input.spawn = 0;
+    before = game.bricks.Remaining();
+
+    while (game.result == Game::PLAYING && game.ticks < max_ticks)
+      game.Step(player != NULL ? player(game) : input);
+
+    out.result = game.result;
+    out.bricks = before - game.bricks.Remaining();
+    out.ticks = game.ticks;
+  });
+
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  steals = pool.Steals();
+
+  for (k = 0; k < players.size(); k++)
+    if (players[k] != NULL)
+    {
+      players[k]->~BatchPlayer();
+      allocator.deallocate(players[k], 1);
+    }
+
+  wins = 0;
+  losses = 0;
+  timeouts = 0;
+  ticks = 0;
+  ticks_to_clear = 0;
+  bricks = 0;
+
+  for (i = 0; i < games; i++)
+  {
+    ticks += results[i].ticks;
+    bricks += results[i].bricks;
+    if (results[i].result == Game::WIN)
+    {
+      wins++;
+      ticks_to_clear += results[i].ticks;
+    }
+    else if (results[i].result == Game::LOSE)
+      losses++;
+    else
+      timeouts++;
+  }
+
+  return NULL;
+}
+
+BatchRunner::~BatchRunner()
+{
+}
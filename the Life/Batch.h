@@ -0,0 +1,61 @@
+#pragma once
+
+// Thousands of independent games on every core, for balancing and for
+// judging players. Each worker thread keeps one Game of its own and plays
+// game after game in it; game i always starts the same way for a seed,
+// its ball moved and turned by its own random stream, so the totals do
+// not depend on the thread count. Everything a worker writes while it
+// plays (its Game, each game's result) sits in cache lines of its own.
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "Game.h"
+#include "Pool.h"
+
+// How one game ended, a cache line per game
+struct alignas(64) BatchResult
+{
+  int result;          // Game::Result
+  int bricks;          // Destroyed
+  long long ticks;
+};
+
+class BatchRunner
+{
+public:
+  int games;
+  uint64_t seed;
+  long long max_ticks;   // A game still playing then is a timeout
+  int tick_rate;
+  float speed;           // Ball speed in pixels per second, 0 keeps the default
+  std::shared_ptr<const LevelFile> level;  // NULL for the classic level
+  GameInput (*player)(const Game& game);   // Input for the next tick
+
+  // Totals of the last Run
+  int wins;
+  int losses;
+  int timeouts;
+  long long ticks;
+  long long ticks_to_clear;  // Summed over the games won
+  long long bricks;
+  long long steals;          // Work moved between threads
+  double seconds;            // Wall clock
+
+  BatchRunner();
+
+  // Plays every game on threads workers, 0 for one per hardware thread.
+  // NULL on success, else what is wrong with the level
+  const char* Run(int threads);
+
+  const std::vector<BatchResult, AlignedAllocator<BatchResult, 64> >& Results() const
+  {
+    return results;
+  }
+
+  ~BatchRunner();
+
+private:
+  std::vector<BatchResult, AlignedAllocator<BatchResult, 64> > results;
+};
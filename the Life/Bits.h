@@ -0,0 +1,82 @@
+#pragma once
+
+// Bit scans and population count, one instruction on the compilers we
+// use, and the function attributes the SIMD kernels need
+
+#include <stdint.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// GCC and Clang only emit SSE2/AVX2 code in functions that ask for it,
+// MSVC always can
+#if defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+static inline int CountTrailingZeros(uint32_t mask)
+{
+#ifdef _MSC_VER
+  unsigned long index;
+
+  _BitScanForward(&index, mask);
+  return (int)index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+static inline int CountTrailingZeros64(uint64_t mask)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index;
+
+  _BitScanForward64(&index, mask);
+  return (int)index;
+#elif defined(_MSC_VER)
+  if ((uint32_t)mask != 0)
+    return CountTrailingZeros((uint32_t)mask);
+  return 32 + CountTrailingZeros((uint32_t)(mask >> 32));
+#else
+  return __builtin_ctzll(mask);
+#endif
+}
+
+static inline int PopCount64(uint64_t mask)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+  return (int)__popcnt64(mask);
+#elif defined(_MSC_VER)
+  return (int)(__popcnt((uint32_t)mask) + __popcnt((uint32_t)(mask >> 32)));
+#else
+  return __builtin_popcountll(mask);
+#endif
+}
+
+// Index of the highest set bit, mask not 0
+static inline int HighestBit64(uint64_t mask)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index;
+
+  _BitScanReverse64(&index, mask);
+  return (int)index;
+#elif defined(_MSC_VER)
+  unsigned long index;
+
+  if ((uint32_t)(mask >> 32) != 0)
+  {
+    _BitScanReverse(&index, (uint32_t)(mask >> 32));
+    return 32 + (int)index;
+  }
+  _BitScanReverse(&index, (uint32_t)mask);
+  return (int)index;
+#else
+  return 63 - __builtin_clzll(mask);
+#endif
+}
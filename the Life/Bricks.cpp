@@ -0,0 +1,346 @@
+#include "Bricks.h"
+
+#include "Bits.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define BRICKS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+static int OverlapScalar(const BrickSoA& bricks, int first, int last,
+                         int x0, int y0, int x1, int y1, int* out)
+{
+  const int32_t* pos_x = bricks.pos_x;
+  const int32_t* pos_y = bricks.pos_y;
+  const int32_t* weight = bricks.weight;
+  const int32_t* hight = bricks.hight;
+  const uint64_t* live = bricks.live.data();
+  uint64_t bits;
+  int word, i, n = 0;
+
+  if (first >= last)
+    return 0;
+
+  // Only the live bricks, found a word at a time with a bit scan. The
+  // test itself is branch free: always store, only advance on a hit
+  for (word = first >> 6; word <= (last - 1) >> 6; word++)
+  {
+    bits = live[word];
+    if (word == first >> 6)
+      bits &= ~(uint64_t)0 << (first & 63);
+    if (word == (last - 1) >> 6 && (last & 63) != 0)
+      bits &= ~(~(uint64_t)0 << (last & 63));
+
+    for (; bits != 0; bits &= bits - 1)
+    {
+      i = word * 64 + CountTrailingZeros64(bits);
+      out[n] = i;
+      n += (pos_x[i] < x1) & (pos_x[i] + weight[i] > x0) & (pos_y[i] < y1) & (pos_y[i] + hight[i] > y0);
+    }
+  }
+
+  return n;
+}
+
+#ifdef BRICKS_X86
+
+TARGET_SSE2
+static int OverlapSSE2(const BrickSoA& bricks, int first, int last,
+                       int x0, int y0, int x1, int y1, int* out)
+{
+  const int32_t* pos_x = bricks.pos_x;
+  const int32_t* pos_y = bricks.pos_y;
+  const int32_t* weight = bricks.weight;
+  const int32_t* hight = bricks.hight;
+  const __m128i vx0 = _mm_set1_epi32(x0);
+  const __m128i vy0 = _mm_set1_epi32(y0);
+  const __m128i vx1 = _mm_set1_epi32(x1);
+  const __m128i vy1 = _mm_set1_epi32(y1);
+  __m128i x, y, hit;
+  int i = first, n = 0, mask;
+
+  // Four bricks per step, none of the loads when all four are gone
+  for (; i + 4 <= last; i += 4)
+  {
+    mask = (int)bricks.LiveBits(i, 4);
+    if (mask == 0)
+      continue;
+
+    x = _mm_loadu_si128((const __m128i*)(pos_x + i));
+    y = _mm_loadu_si128((const __m128i*)(pos_y + i));
+
+    hit = _mm_and_si128(_mm_cmpgt_epi32(vx1, x),
+                        _mm_cmpgt_epi32(_mm_add_epi32(x, _mm_loadu_si128((const __m128i*)(weight + i))), vx0));
+    hit = _mm_and_si128(hit, _mm_cmpgt_epi32(vy1, y));
+    hit = _mm_and_si128(hit, _mm_cmpgt_epi32(_mm_add_epi32(y, _mm_loadu_si128((const __m128i*)(hight + i))), vy0));
+
+    mask &= _mm_movemask_ps(_mm_castsi128_ps(hit));
+    while (mask != 0)
+    {
+      out[n++] = i + CountTrailingZeros((uint32_t)mask);
+      mask &= mask - 1;
+    }
+  }
+
+  return n + OverlapScalar(bricks, i, last, x0, y0, x1, y1, out + n);
+}
+
+TARGET_AVX2
+static int OverlapAVX2(const BrickSoA& bricks, int first, int last,
+                       int x0, int y0, int x1, int y1, int* out)
+{
+  const int32_t* pos_x = bricks.pos_x;
+  const int32_t* pos_y = bricks.pos_y;
+  const int32_t* weight = bricks.weight;
+  const int32_t* hight = bricks.hight;
+  const __m256i vx0 = _mm256_set1_epi32(x0);
+  const __m256i vy0 = _mm256_set1_epi32(y0);
+  const __m256i vx1 = _mm256_set1_epi32(x1);
+  const __m256i vy1 = _mm256_set1_epi32(y1);
+  __m256i x, y, hit;
+  int i = first, n = 0, mask;
+
+  // Eight bricks per step, none of the loads when all eight are gone
+  for (; i + 8 <= last; i += 8)
+  {
+    mask = (int)bricks.LiveBits(i, 8);
+    if (mask == 0)
+      continue;
+
+    x = _mm256_loadu_si256((const __m256i*)(pos_x + i));
+    y = _mm256_loadu_si256((const __m256i*)(pos_y + i));
+
+    hit = _mm256_and_si256(_mm256_cmpgt_epi32(vx1, x),
+                           _mm256_cmpgt_epi32(_mm256_add_epi32(x, _mm256_loadu_si256((const __m256i*)(weight + i))), vx0));
+    hit = _mm256_and_si256(hit, _mm256_cmpgt_epi32(vy1, y));
+    hit = _mm256_and_si256(hit, _mm256_cmpgt_epi32(_mm256_add_epi32(y, _mm256_loadu_si256((const __m256i*)(hight + i))), vy0));
+
+    mask &= _mm256_movemask_ps(_mm256_castsi256_ps(hit));
+    while (mask != 0)
+    {
+      out[n++] = i + CountTrailingZeros((uint32_t)mask);
+      mask &= mask - 1;
+    }
+  }
+
+  // GCC leaves this out on the tail call, and the SSE code after pays for
+  // every dirty upper half it finds
+  _mm256_zeroupper();
+
+  return n + OverlapScalar(bricks, i, last, x0, y0, x1, y1, out + n);
+}
+
+#endif
+
+BrickSoA::OverlapKernel BrickSoA::kernel = OverlapScalar;
+int BrickSoA::kernel_id = BrickSoA::SCALAR;
+
+// Without this the scalar kernel would run until someone calls SelectKernel
+static struct KernelStartup
+{
+  KernelStartup()
+  {
+    BrickSoA::SelectKernel(BrickSoA::DetectKernel());
+  }
+} kernel_startup;
+
+int BrickSoA::DetectKernel()
+{
+#ifdef BRICKS_X86
+#if defined(_MSC_VER)
+  int info[4];
+
+  __cpuid(info, 1);
+  bool sse2 = (info[3] & (1 << 26)) != 0;
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool avx2 = false;
+
+  // AVX2 also needs the OS to save the YMM registers
+  if (osxsave && (_xgetbv(0) & 6) == 6)
+  {
+    __cpuidex(info, 7, 0);
+    avx2 = (info[1] & (1 << 5)) != 0;
+  }
+
+  if (avx2)
+    return AVX2;
+  if (sse2)
+    return SSE2;
+#else
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return SSE2;
+#endif
+#endif
+  return SCALAR;
+}
+
+void BrickSoA::SelectKernel(int which)
+{
+  kernel = OverlapScalar;
+  kernel_id = SCALAR;
+
+#ifdef BRICKS_X86
+  if (which == AVX2)
+  {
+    kernel = OverlapAVX2;
+    kernel_id = AVX2;
+  }
+  else if (which == SSE2)
+  {
+    kernel = OverlapSSE2;
+    kernel_id = SSE2;
+  }
+#endif
+}
+
+int BrickSoA::SelectedKernel()
+{
+  return kernel_id;
+}
+
+BrickSoA::BrickSoA()
+{
+  count = 0;
+  arrays = std::make_shared<Arrays>();
+  Point();
+}
+
+void BrickSoA::Point()
+{
+  if (arrays->owner)
+    return;
+
+  pos_x = arrays->pos_x.data();
+  pos_y = arrays->pos_y.data();
+  weight = arrays->weight.data();
+  hight = arrays->hight.data();
+  color = arrays->color.data();
+}
+
+void BrickSoA::Clear()
+{
+  if (arrays.use_count() == 1 && !arrays->owner)
+  {
+    arrays->pos_x.clear();
+    arrays->pos_y.clear();
+    arrays->weight.clear();
+    arrays->hight.clear();
+    arrays->color.clear();
+  }
+  else
+    arrays = std::make_shared<Arrays>();
+
+  Point();
+  live.clear();
+  live_rows.clear();
+  count = 0;
+}
+
+void BrickSoA::Add(int x, int y, int w, int h, uint32_t rgba)
+{
+  // Someone else still reads these arrays, write to a copy
+  if (arrays.use_count() > 1 || arrays->owner)
+  {
+    std::shared_ptr<Arrays> copy = std::make_shared<Arrays>();
+
+    copy->pos_x.assign(pos_x, pos_x + count);
+    copy->pos_y.assign(pos_y, pos_y + count);
+    copy->weight.assign(weight, weight + count);
+    copy->hight.assign(hight, hight + count);
+    copy->color.assign(color, color + count);
+    arrays = copy;
+  }
+
+  arrays->pos_x.push_back(x);
+  arrays->pos_y.push_back(y);
+  arrays->weight.push_back(w);
+  arrays->hight.push_back(h);
+  arrays->color.push_back(rgba);
+  Point();
+
+  if ((count & 63) == 0)
+  {
+    if ((live.size() & 63) == 0)
+      live_rows.push_back(0);
+    live.push_back(0);
+  }
+  live[count >> 6] |= (uint64_t)1 << (count & 63);
+  live_rows[count >> 12] |= (uint64_t)1 << ((count >> 6) & 63);
+
+  count++;
+}
+
+int BrickSoA::Remaining() const
+{
+  size_t r;
+  uint64_t rows;
+  int n = 0;
+
+  // Only the words live_rows says have something in them
+  for (r = 0; r < live_rows.size(); r++)
+    for (rows = live_rows[r]; rows != 0; rows &= rows - 1)
+      n += PopCount64(live[r * 64 + CountTrailingZeros64(rows)]);
+
+  return n;
+}
+
+void BrickSoA::Allocate(int n, int32_t*& x, int32_t*& y, int32_t*& w, int32_t*& h, uint32_t*& rgba)
+{
+  arrays = std::make_shared<Arrays>();
+  arrays->pos_x.resize(n);
+  arrays->pos_y.resize(n);
+  arrays->weight.resize(n);
+  arrays->hight.resize(n);
+  arrays->color.resize(n);
+  Point();
+  count = n;
+  Revive();
+
+  x = arrays->pos_x.data();
+  y = arrays->pos_y.data();
+  w = arrays->weight.data();
+  h = arrays->hight.data();
+  rgba = arrays->color.data();
+}
+
+void BrickSoA::Borrow(std::shared_ptr<const void> owner, int n, const int32_t* x, const int32_t* y,
+                      const int32_t* w, const int32_t* h, const uint32_t* rgba)
+{
+  // The same owner again, as every reset of a level does, reuses its record
+  if (arrays.use_count() != 1 || arrays->owner != owner)
+  {
+    arrays = std::make_shared<Arrays>();
+    arrays->owner = owner;
+  }
+  pos_x = x;
+  pos_y = y;
+  weight = w;
+  hight = h;
+  color = rgba;
+  count = n;
+  Revive();
+}
+
+// Every brick alive, whole words at a time
+void BrickSoA::Revive()
+{
+  int words = (count + 63) >> 6;
+
+  live.assign(words, ~(uint64_t)0);
+  if ((count & 63) != 0)
+    live[words - 1] = ~(~(uint64_t)0 << (count & 63));
+
+  live_rows.assign((words + 63) >> 6, ~(uint64_t)0);
+  if ((words & 63) != 0)
+    live_rows[live_rows.size() - 1] = ~(~(uint64_t)0 << (words & 63));
+}
+
+BrickSoA::~BrickSoA()
+{
+}
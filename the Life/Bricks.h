@@ -0,0 +1,211 @@
+#pragma once
+
+// Bricks stored as separate arrays (structure of arrays), so a scan over
+// one field touches only that field and SIMD can test several bricks per
+// instruction. Arrays are 32-byte aligned.
+//
+// Whether a brick is still drawn is one bit in a packed bitset, and every
+// 64 bricks (one word, a "row" of the bitset) have a bit in live_rows, so
+// a run of empty words is skipped with one compare.
+//
+// The position, size and color arrays never change during a game. They
+// are shared between copies (a snapshot copies only the live bits), and
+// can point straight into a loaded level file. Add copies them first if
+// anyone else still looks at them.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "Bits.h"
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+// std::allocator with the alignment AVX2 loads want
+template <class T, size_t Alignment = 32>
+class AlignedAllocator
+{
+public:
+  typedef T value_type;
+
+  template <class U>
+  struct rebind
+  {
+    typedef AlignedAllocator<U, Alignment> other;
+  };
+
+  AlignedAllocator() {}
+
+  template <class U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+  T* allocate(size_t n)
+  {
+    void* p;
+
+#ifdef _MSC_VER
+    p = _aligned_malloc(n * sizeof(T), Alignment);
+#else
+    if (posix_memalign(&p, Alignment, n * sizeof(T)) != 0)
+      p = NULL;
+#endif
+    if (p == NULL)
+      throw std::bad_alloc();
+
+    return (T*)p;
+  }
+
+  void deallocate(T* p, size_t)
+  {
+#ifdef _MSC_VER
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+  }
+
+  template <class U>
+  bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+
+  template <class U>
+  bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+class BrickSoA
+{
+public:
+  const int32_t* pos_x;
+  const int32_t* pos_y;
+  const int32_t* weight;
+  const int32_t* hight;
+  const uint32_t* color;            // 0xRRGGBBAA
+  std::vector<uint64_t> live;       // Bit i set while brick i is drawn
+  std::vector<uint64_t> live_rows;  // Bit w set while live[w] is not 0
+
+  BrickSoA();
+
+  int Count() const
+  {
+    return count;
+  }
+
+  void Clear();
+
+  void Add(int x, int y, int w, int h, uint32_t rgba);
+
+  // Room for count bricks, all alive, for code that fills the arrays
+  // itself through the pointers it gets back
+  void Allocate(int count, int32_t*& x, int32_t*& y, int32_t*& w, int32_t*& h, uint32_t*& rgba);
+
+  // Use count bricks from arrays someone else owns, all of them alive.
+  // owner keeps the arrays alive for as long as any copy needs them
+  void Borrow(std::shared_ptr<const void> owner, int count, const int32_t* x, const int32_t* y,
+              const int32_t* w, const int32_t* h, const uint32_t* rgba);
+
+  bool Alive(int i) const
+  {
+    return (live[i >> 6] >> (i & 63) & 1) != 0;
+  }
+
+  void Kill(int i)
+  {
+    int word = i >> 6;
+
+    live[word] &= ~((uint64_t)1 << (i & 63));
+    if (live[word] == 0)
+      live_rows[word >> 6] &= ~((uint64_t)1 << (word & 63));
+  }
+
+  // Up to 32 live bits starting at brick i, bit 0 is brick i.
+  // i + n must not be past Count()
+  uint32_t LiveBits(int i, int n) const
+  {
+    int word = i >> 6, shift = i & 63;
+    uint64_t bits = live[word] >> shift;
+
+    if (shift + n > 64)
+      bits |= live[word + 1] << (64 - shift);
+
+    return (uint32_t)bits & (uint32_t)(((uint64_t)1 << n) - 1);
+  }
+
+  // Calls visit(index) for every live brick, in index order
+  template <class F>
+  void ForEachAlive(F visit) const
+  {
+    size_t r, word;
+    uint64_t rows, bits;
+
+    for (r = 0; r < live_rows.size(); r++)
+      for (rows = live_rows[r]; rows != 0; rows &= rows - 1)
+      {
+        word = r * 64 + CountTrailingZeros64(rows);
+        for (bits = live[word]; bits != 0; bits &= bits - 1)
+          visit((int)(word * 64 + CountTrailingZeros64(bits)));
+      }
+  }
+
+  int Remaining() const;  // Live bricks, by popcount
+
+  bool AnyAlive() const
+  {
+    size_t r;
+
+    for (r = 0; r < live_rows.size(); r++)
+      if (live_rows[r] != 0)
+        return true;
+
+    return false;
+  }
+
+  // Writes the index of every live brick in [first, last) that overlaps
+  // the box x0 < x < x1, y0 < y < y1 to out, returns how many.
+  // out must have room for last - first indices
+  int FindOverlaps(int first, int last, int x0, int y0, int x1, int y1, int* out) const
+  {
+    return kernel(*this, first, last, x0, y0, x1, y1, out);
+  }
+
+  enum Kernel
+  {
+    SCALAR,
+    SSE2,
+    AVX2
+  };
+
+  // The overlap kernel used by every BrickSoA. It is detected at startup;
+  // the window build picks it again from SDL_HasAVX2/SDL_HasSSE2
+  static void SelectKernel(int which);
+  static int DetectKernel();
+  static int SelectedKernel();
+
+  ~BrickSoA();
+
+private:
+  struct Arrays
+  {
+    std::vector<int32_t, AlignedAllocator<int32_t> > pos_x;
+    std::vector<int32_t, AlignedAllocator<int32_t> > pos_y;
+    std::vector<int32_t, AlignedAllocator<int32_t> > weight;
+    std::vector<int32_t, AlignedAllocator<int32_t> > hight;
+    std::vector<uint32_t, AlignedAllocator<uint32_t> > color;
+    std::shared_ptr<const void> owner;  // Set when the pointers go somewhere else
+  };
+
+  int count;
+  std::shared_ptr<Arrays> arrays;
+
+  void Point();
+  void Revive();
+
+  typedef int (*OverlapKernel)(const BrickSoA& bricks, int first, int last,
+                               int x0, int y0, int x1, int y1, int* out);
+
+  static OverlapKernel kernel;
+  static int kernel_id;
+};
@@ -0,0 +1,476 @@
+#include "Classic.h"
+
+#include <algorithm>
+
+#include "Bits.h"
+#include "Generator.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define CLASSIC_X86
+#include <immintrin.h>
+#endif
+
+static const int STEP = 10;  // Pixels a tick, for the ball and the paddle
+
+ClassicGames::ClassicGames(int n)
+{
+  int padded = (n + LANES - 1) / LANES * LANES;
+
+  games = n;
+  ball_x.assign(padded, 0);
+  ball_y.assign(padded, 0);
+  direction_x.assign(padded, 0);
+  direction_y.assign(padded, 0);
+  paddle_x.assign(padded, 0);
+  live.assign(padded, 0);
+  ticks.assign(padded, 0);
+  result.assign(padded, WIN);
+
+  width = 640;
+  height = 480;
+  paddle_w = 200;
+  paddle_h = 20;
+
+  brick_count = 4;
+  brick_x[0] = 10;
+  brick_x[1] = 170;
+  brick_x[2] = 330;
+  brick_x[3] = 490;
+  for (int i = 0; i < 4; i++)
+  {
+    brick_y[i] = 10;
+    brick_w[i] = 150;
+    brick_h[i] = 70;
+  }
+  brick_w[3] = 140;
+
+  paddle_y = height - 50;
+}
+
+bool ClassicGames::UseBricks(const BrickSoA& bricks, int w, int h)
+{
+  int i;
+
+  if (bricks.Count() > MAX_BRICKS)
+    return false;
+
+  width = w;
+  height = h;
+  paddle_y = height - 50;
+  brick_count = bricks.Count();
+
+  for (i = 0; i < brick_count; i++)
+  {
+    brick_x[i] = bricks.pos_x[i];
+    brick_y[i] = bricks.pos_y[i];
+    brick_w[i] = bricks.weight[i];
+    brick_h[i] = bricks.hight[i];
+  }
+
+  return true;
+}
+
+void ClassicGames::Reset(uint64_t seed)
+{
+  uint32_t all = brick_count == 32 ? ~0u : (1u << brick_count) - 1;
+  int g;
+
+  // Where the original put them on 640 x 480, from the bottom middle
+  for (g = 0; g < (int)ball_x.size(); g++)
+  {
+    Xoshiro256 random(seed, (uint64_t)g);
+
+    ball_x[g] = width / 2 - 60 + STEP * ((int)random.Below(21) - 10);
+    ball_y[g] = height - 180;
+    direction_x[g] = random.Below(2) == 0 ? -1 : 1;
+    direction_y[g] = 1;
+    paddle_x[g] = (width - paddle_w) / 2;
+    live[g] = (int32_t)all;
+    ticks[g] = 0;
+    result[g] = g < games ? PLAYING : WIN;  // Padding never plays
+  }
+}
+
+void ClassicGames::StepScalar(int n, int first, int end)
+{
+  int g, t, i, x, y, dx, dy, px, tick, res, middle;
+  uint32_t alive;
+
+  end = std::min(end, games);
+  for (g = first; g < end; g++)
+  {
+    if (result[g] != PLAYING)
+      continue;
+
+    x = ball_x[g];
+    y = ball_y[g];
+    dx = direction_x[g];
+    dy = direction_y[g];
+    px = paddle_x[g];
+    alive = (uint32_t)live[g];
+    tick = ticks[g];
+    res = PLAYING;
+
+    for (t = 0; t < n && res == PLAYING; t++)
+    {
+      if (y < 10)
+        dy = 1;
+      if (y > height - 30)
+        dy = -1;
+      if (x < 10)
+        dx = 1;
+      if (x > width - 30)
+        dx = -1;
+
+      if (y < paddle_y + paddle_h && paddle_y - paddle_h < y && x < px + paddle_w && px < x)
+        dy = -1;
+
+      for (i = 0; i < brick_count; i++)
+      {
+        if ((alive >> i & 1) != 0 && y - 10 < brick_y[i] + brick_h[i] && y + 10 > brick_y[i] &&
+            x > brick_x[i] && x < brick_x[i] + brick_w[i])
+        {
+          dy = 1;
+          alive &= ~(1u << i);
+        }
+      }
+
+      // Paddle middle after the ball's
+      middle = px + paddle_w / 2;
+      if (x + 10 > middle + STEP)
+        px += STEP;
+      else if (x + 10 < middle - STEP)
+        px -= STEP;
+      if (px < 0)
+        px = 0;
+      if (px > width - paddle_w)
+        px = width - paddle_w;
+
+      x += dx * STEP;
+      y += dy * STEP;
+      tick++;
+
+      if (y > height - 30)
+        res = LOSE;
+      else if (alive == 0)
+        res = WIN;
+    }
+
+    ball_x[g] = x;
+    ball_y[g] = y;
+    direction_x[g] = dx;
+    direction_y[g] = dy;
+    paddle_x[g] = px;
+    live[g] = (int32_t)alive;
+    ticks[g] = tick;
+    result[g] = res;
+  }
+}
+
+// A ball's top left has to be strictly between these rows to touch any
+// brick: y - 10 under a brick's bottom and y + 10 over its top
+int ClassicGames::BandTop() const
+{
+  int i, top = brick_count > 0 ? brick_y[0] : 0;
+
+  for (i = 1; i < brick_count; i++)
+    top = std::min(top, brick_y[i]);
+
+  return top - 10;
+}
+
+int ClassicGames::BandBottom() const
+{
+  int i, bottom = brick_count > 0 ? brick_y[0] + brick_h[0] : 0;
+
+  for (i = 1; i < brick_count; i++)
+    bottom = std::max(bottom, brick_y[i] + brick_h[i]);
+
+  return bottom + 10;
+}
+
+#ifdef CLASSIC_X86
+
+// Masked select without SSE4.1: b where mask, else a
+TARGET_SSE2
+static inline __m128i Select(__m128i a, __m128i b, __m128i mask)
+{
+  return _mm_or_si128(_mm_andnot_si128(mask, a), _mm_and_si128(mask, b));
+}
+
+TARGET_SSE2
+void ClassicGames::StepSSE2(int n, int first, int end)
+{
+  const __m128i one = _mm_set1_epi32(1);
+  const __m128i minus_one = _mm_set1_epi32(-1);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i step = _mm_set1_epi32(STEP);
+  const __m128i ten = _mm_set1_epi32(10);
+  const __m128i bottom = _mm_set1_epi32(height - 30);
+  const __m128i right_wall = _mm_set1_epi32(width - 30);
+  const __m128i paddle_top = _mm_set1_epi32(paddle_y - paddle_h);
+  const __m128i paddle_bottom = _mm_set1_epi32(paddle_y + paddle_h);
+  const __m128i paddle_w_v = _mm_set1_epi32(paddle_w);
+  const __m128i paddle_half = _mm_set1_epi32(paddle_w / 2);
+  const __m128i paddle_max = _mm_set1_epi32(width - paddle_w);
+  const __m128i win = _mm_set1_epi32(WIN);
+  const __m128i lose = _mm_set1_epi32(LOSE);
+  const __m128i band_top = _mm_set1_epi32(BandTop());
+  const __m128i band_bottom = _mm_set1_epi32(BandBottom());
+  __m128i bit[MAX_BRICKS], above[MAX_BRICKS], below[MAX_BRICKS], left[MAX_BRICKS], right[MAX_BRICKS];
+  __m128i x, y, dx, dy, px, alive, tick, res;
+  __m128i playing, mask, middle, nx, ny, ndx, ndy, npx, nalive, lost, won;
+  int g, t, i;
+
+  // Each brick's bounds broadcast once, moved by the ball's half size
+  // so a tick compares y and x straight
+  for (i = 0; i < brick_count; i++)
+  {
+    bit[i] = _mm_set1_epi32((int32_t)(1u << i));
+    above[i] = _mm_set1_epi32(brick_y[i] + brick_h[i] + 10);
+    below[i] = _mm_set1_epi32(brick_y[i] - 10);
+    left[i] = _mm_set1_epi32(brick_x[i]);
+    right[i] = _mm_set1_epi32(brick_x[i] + brick_w[i]);
+  }
+
+  for (g = first; g < end; g += 4)
+  {
+    x = _mm_load_si128((const __m128i*)&ball_x[g]);
+    y = _mm_load_si128((const __m128i*)&ball_y[g]);
+    dx = _mm_load_si128((const __m128i*)&direction_x[g]);
+    dy = _mm_load_si128((const __m128i*)&direction_y[g]);
+    px = _mm_load_si128((const __m128i*)&paddle_x[g]);
+    alive = _mm_load_si128((const __m128i*)&live[g]);
+    tick = _mm_load_si128((const __m128i*)&ticks[g]);
+    res = _mm_load_si128((const __m128i*)&result[g]);
+
+    for (t = 0; t < n; t++)
+    {
+      playing = _mm_cmpeq_epi32(res, zero);
+      if (_mm_movemask_epi8(playing) == 0)
+        break;
+
+      // Walls
+      ndy = Select(dy, one, _mm_cmplt_epi32(y, ten));
+      ndy = Select(ndy, minus_one, _mm_cmpgt_epi32(y, bottom));
+      ndx = Select(dx, one, _mm_cmplt_epi32(x, ten));
+      ndx = Select(ndx, minus_one, _mm_cmpgt_epi32(x, right_wall));
+
+      // Paddle
+      mask = _mm_and_si128(_mm_and_si128(_mm_cmplt_epi32(y, paddle_bottom), _mm_cmplt_epi32(paddle_top, y)),
+                           _mm_and_si128(_mm_cmplt_epi32(x, _mm_add_epi32(px, paddle_w_v)), _mm_cmplt_epi32(px, x)));
+      ndy = Select(ndy, minus_one, mask);
+
+      // Bricks, only while some ball is level with them
+      nalive = alive;
+      if (_mm_movemask_epi8(_mm_and_si128(_mm_cmplt_epi32(y, band_bottom), _mm_cmpgt_epi32(y, band_top))) != 0)
+        for (i = 0; i < brick_count; i++)
+        {
+          mask = _mm_cmpeq_epi32(_mm_and_si128(nalive, bit[i]), bit[i]);
+          mask = _mm_and_si128(mask, _mm_and_si128(_mm_cmplt_epi32(y, above[i]), _mm_cmpgt_epi32(y, below[i])));
+          mask = _mm_and_si128(mask, _mm_and_si128(_mm_cmpgt_epi32(x, left[i]), _mm_cmplt_epi32(x, right[i])));
+          ndy = Select(ndy, one, mask);
+          nalive = _mm_andnot_si128(_mm_and_si128(mask, bit[i]), nalive);
+        }
+
+      // Paddle after the ball, then kept on the field
+      middle = _mm_add_epi32(px, paddle_half);
+      npx = _mm_add_epi32(px, _mm_and_si128(_mm_cmpgt_epi32(_mm_add_epi32(x, ten), _mm_add_epi32(middle, step)), step));
+      npx = _mm_sub_epi32(npx, _mm_and_si128(_mm_cmplt_epi32(_mm_add_epi32(x, ten), _mm_sub_epi32(middle, step)), step));
+      npx = _mm_and_si128(npx, _mm_cmpgt_epi32(npx, zero));
+      npx = Select(npx, paddle_max, _mm_cmpgt_epi32(npx, paddle_max));
+
+      // Direction times 10 as d * 8 + d * 2, SSE2 has no 32-bit multiply
+      nx = _mm_add_epi32(x, _mm_add_epi32(_mm_slli_epi32(ndx, 3), _mm_slli_epi32(ndx, 1)));
+      ny = _mm_add_epi32(y, _mm_add_epi32(_mm_slli_epi32(ndy, 3), _mm_slli_epi32(ndy, 1)));
+
+      lost = _mm_cmpgt_epi32(ny, bottom);
+      won = _mm_andnot_si128(lost, _mm_cmpeq_epi32(nalive, zero));
+
+      // Only the games still playing take the tick
+      x = Select(x, nx, playing);
+      y = Select(y, ny, playing);
+      dx = Select(dx, ndx, playing);
+      dy = Select(dy, ndy, playing);
+      px = Select(px, npx, playing);
+      alive = Select(alive, nalive, playing);
+      tick = _mm_sub_epi32(tick, playing);
+      res = Select(res, win, _mm_and_si128(playing, won));
+      res = Select(res, lose, _mm_and_si128(playing, lost));
+    }
+
+    _mm_store_si128((__m128i*)&ball_x[g], x);
+    _mm_store_si128((__m128i*)&ball_y[g], y);
+    _mm_store_si128((__m128i*)&direction_x[g], dx);
+    _mm_store_si128((__m128i*)&direction_y[g], dy);
+    _mm_store_si128((__m128i*)&paddle_x[g], px);
+    _mm_store_si128((__m128i*)&live[g], alive);
+    _mm_store_si128((__m128i*)&ticks[g], tick);
+    _mm_store_si128((__m128i*)&result[g], res);
+  }
+}
+
+TARGET_AVX2
+void ClassicGames::StepAVX2(int n, int first, int end)
+{
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i minus_one = _mm256_set1_epi32(-1);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i step = _mm256_set1_epi32(STEP);
+  const __m256i ten = _mm256_set1_epi32(10);
+  const __m256i bottom = _mm256_set1_epi32(height - 30);
+  const __m256i right_wall = _mm256_set1_epi32(width - 30);
+  const __m256i paddle_top = _mm256_set1_epi32(paddle_y - paddle_h);
+  const __m256i paddle_bottom = _mm256_set1_epi32(paddle_y + paddle_h);
+  const __m256i paddle_w_v = _mm256_set1_epi32(paddle_w);
+  const __m256i paddle_half = _mm256_set1_epi32(paddle_w / 2);
+  const __m256i paddle_max = _mm256_set1_epi32(width - paddle_w);
+  const __m256i win = _mm256_set1_epi32(WIN);
+  const __m256i lose = _mm256_set1_epi32(LOSE);
+  const __m256i band_top = _mm256_set1_epi32(BandTop());
+  const __m256i band_bottom = _mm256_set1_epi32(BandBottom());
+  __m256i bit[MAX_BRICKS], above[MAX_BRICKS], below[MAX_BRICKS], left[MAX_BRICKS], right[MAX_BRICKS];
+  __m256i x, y, dx, dy, px, alive, tick, res;
+  __m256i playing, mask, middle, nx, ny, ndx, ndy, npx, nalive, lost, won;
+  int g, t, i;
+
+  for (i = 0; i < brick_count; i++)
+  {
+    bit[i] = _mm256_set1_epi32((int32_t)(1u << i));
+    above[i] = _mm256_set1_epi32(brick_y[i] + brick_h[i] + 10);
+    below[i] = _mm256_set1_epi32(brick_y[i] - 10);
+    left[i] = _mm256_set1_epi32(brick_x[i]);
+    right[i] = _mm256_set1_epi32(brick_x[i] + brick_w[i]);
+  }
+
+  for (g = first; g < end; g += 8)
+  {
+    x = _mm256_load_si256((const __m256i*)&ball_x[g]);
+    y = _mm256_load_si256((const __m256i*)&ball_y[g]);
+    dx = _mm256_load_si256((const __m256i*)&direction_x[g]);
+    dy = _mm256_load_si256((const __m256i*)&direction_y[g]);
+    px = _mm256_load_si256((const __m256i*)&paddle_x[g]);
+    alive = _mm256_load_si256((const __m256i*)&live[g]);
+    tick = _mm256_load_si256((const __m256i*)&ticks[g]);
+    res = _mm256_load_si256((const __m256i*)&result[g]);
+
+    for (t = 0; t < n; t++)
+    {
+      playing = _mm256_cmpeq_epi32(res, zero);
+      if (_mm256_movemask_epi8(playing) == 0)
+        break;
+
+      // Walls, y < 10 as 10 > y
+      ndy = _mm256_blendv_epi8(dy, one, _mm256_cmpgt_epi32(ten, y));
+      ndy = _mm256_blendv_epi8(ndy, minus_one, _mm256_cmpgt_epi32(y, bottom));
+      ndx = _mm256_blendv_epi8(dx, one, _mm256_cmpgt_epi32(ten, x));
+      ndx = _mm256_blendv_epi8(ndx, minus_one, _mm256_cmpgt_epi32(x, right_wall));
+
+      // Paddle
+      mask = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(paddle_bottom, y), _mm256_cmpgt_epi32(y, paddle_top)),
+                              _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_add_epi32(px, paddle_w_v), x),
+                                               _mm256_cmpgt_epi32(x, px)));
+      ndy = _mm256_blendv_epi8(ndy, minus_one, mask);
+
+      // Bricks, only while some ball is level with them
+      nalive = alive;
+      if (_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpgt_epi32(band_bottom, y), _mm256_cmpgt_epi32(y, band_top))) != 0)
+        for (i = 0; i < brick_count; i++)
+        {
+          mask = _mm256_cmpeq_epi32(_mm256_and_si256(nalive, bit[i]), bit[i]);
+          mask = _mm256_and_si256(mask, _mm256_and_si256(_mm256_cmpgt_epi32(above[i], y), _mm256_cmpgt_epi32(y, below[i])));
+          mask = _mm256_and_si256(mask, _mm256_and_si256(_mm256_cmpgt_epi32(x, left[i]), _mm256_cmpgt_epi32(right[i], x)));
+          ndy = _mm256_blendv_epi8(ndy, one, mask);
+          nalive = _mm256_andnot_si256(_mm256_and_si256(mask, bit[i]), nalive);
+        }
+
+      // Paddle after the ball, then kept on the field
+      middle = _mm256_add_epi32(px, paddle_half);
+      npx = _mm256_add_epi32(px, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_add_epi32(x, ten), _mm256_add_epi32(middle, step)), step));
+      npx = _mm256_sub_epi32(npx, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_sub_epi32(middle, step), _mm256_add_epi32(x, ten)), step));
+      npx = _mm256_min_epi32(_mm256_max_epi32(npx, zero), paddle_max);
+
+      nx = _mm256_add_epi32(x, _mm256_mullo_epi32(ndx, step));
+      ny = _mm256_add_epi32(y, _mm256_mullo_epi32(ndy, step));
+
+      lost = _mm256_cmpgt_epi32(ny, bottom);
+      won = _mm256_andnot_si256(lost, _mm256_cmpeq_epi32(nalive, zero));
+
+      // Only the games still playing take the tick
+      x = _mm256_blendv_epi8(x, nx, playing);
+      y = _mm256_blendv_epi8(y, ny, playing);
+      dx = _mm256_blendv_epi8(dx, ndx, playing);
+      dy = _mm256_blendv_epi8(dy, ndy, playing);
+      px = _mm256_blendv_epi8(px, npx, playing);
+      alive = _mm256_blendv_epi8(alive, nalive, playing);
+      tick = _mm256_sub_epi32(tick, playing);
+      res = _mm256_blendv_epi8(res, win, _mm256_and_si256(playing, won));
+      res = _mm256_blendv_epi8(res, lose, _mm256_and_si256(playing, lost));
+    }
+
+    _mm256_store_si256((__m256i*)&ball_x[g], x);
+    _mm256_store_si256((__m256i*)&ball_y[g], y);
+    _mm256_store_si256((__m256i*)&direction_x[g], dx);
+    _mm256_store_si256((__m256i*)&direction_y[g], dy);
+    _mm256_store_si256((__m256i*)&paddle_x[g], px);
+    _mm256_store_si256((__m256i*)&live[g], alive);
+    _mm256_store_si256((__m256i*)&ticks[g], tick);
+    _mm256_store_si256((__m256i*)&result[g], res);
+  }
+
+  _mm256_zeroupper();
+}
+
+#else
+
+void ClassicGames::StepSSE2(int n, int first, int end)
+{
+  StepScalar(n, first, end);
+}
+
+void ClassicGames::StepAVX2(int n, int first, int end)
+{
+  StepScalar(n, first, end);
+}
+
+#endif
+
+void ClassicGames::StepKernel(int kernel, int n, int first, int end)
+{
+  if (kernel == BrickSoA::AVX2)
+    StepAVX2(n, first, end);
+  else if (kernel == BrickSoA::SSE2)
+    StepSSE2(n, first, end);
+  else
+    StepScalar(n, first, end);
+}
+
+void ClassicGames::Step(int n)
+{
+  StepKernel(BrickSoA::SelectedKernel(), n, 0, games);
+}
+
+void ClassicGames::Step(WorkStealingPool& pool, int kernel, int n)
+{
+  pool.Run((games + BLOCK - 1) / BLOCK, [&](int block, int)
+  {
+    StepKernel(kernel, n, block * BLOCK, std::min((block + 1) * BLOCK, games));
+  });
+}
+
+uint64_t ClassicGames::Hash(int g) const
+{
+  const int32_t values[8] = { ball_x[g], ball_y[g], direction_x[g], direction_y[g],
+                              paddle_x[g], live[g], ticks[g], result[g] };
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  int k;
+
+  for (k = 0; k < 8; k++)
+    hash = (hash ^ (uint32_t)values[k]) * 0x100000001b3ULL;
+
+  return hash;
+}
+
+ClassicGames::~ClassicGames()
+{
+}
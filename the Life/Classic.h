@@ -0,0 +1,120 @@
+#pragma once
+
+// The game as it first played, stepped for many games at once with one
+// game per SIMD lane. The rules are the ones my_callbackfunc and the main
+// loop had, all integers:
+//
+//   the ball's top left turns at y < 10, y > height - 30, x < 10 and
+//   x > width - 30, goes up when inside the paddle's box and down when it
+//   touches a live brick, which dies; then it moves 10 pixels on each
+//   axis. Past height - 30 after the move is a loss, no bricks a win.
+//
+// Every game has its own ball, paddle and live bricks over one shared
+// brick layout of up to MAX_BRICKS. The paddle follows the ball 10
+// pixels a tick and stays on the field. Game i starts from stream i of
+// the seed: the ball shifted up to 100 pixels and sent either way.
+//
+// StepScalar is the reference, one game at a time with the branches the
+// original had. StepSSE2 and StepAVX2 run 4 and 8 games per register,
+// the state of a group of games staying in registers while it plays and
+// every branch a masked blend. All three leave every game in the same
+// state, Hash tells. The games are independent, so blocks of them can go
+// to a WorkStealingPool's threads with any kernel.
+
+#include <stdint.h>
+#include <vector>
+
+#include "Bricks.h"
+#include "Pool.h"
+
+class ClassicGames
+{
+public:
+  enum
+  {
+    MAX_BRICKS = 32,     // One bit each in live
+    LANES = 8,           // Games are padded to a multiple of this
+    BLOCK = 64           // Games a pool worker takes at a time, whole lanes
+  };
+
+  enum Result
+  {
+    PLAYING,
+    WIN,
+    LOSE
+  };
+
+  // One per game, padded
+  std::vector<int32_t, AlignedAllocator<int32_t> > ball_x;
+  std::vector<int32_t, AlignedAllocator<int32_t> > ball_y;
+  std::vector<int32_t, AlignedAllocator<int32_t> > direction_x;  // -1 or 1
+  std::vector<int32_t, AlignedAllocator<int32_t> > direction_y;
+  std::vector<int32_t, AlignedAllocator<int32_t> > paddle_x;
+  std::vector<int32_t, AlignedAllocator<int32_t> > live;         // Bit i while brick i stands
+  std::vector<int32_t, AlignedAllocator<int32_t> > ticks;
+  std::vector<int32_t, AlignedAllocator<int32_t> > result;
+
+  // The same for every game
+  int width;
+  int height;
+  int paddle_y;
+  int paddle_w;
+  int paddle_h;
+  int brick_count;
+  int32_t brick_x[MAX_BRICKS];
+  int32_t brick_y[MAX_BRICKS];
+  int32_t brick_w[MAX_BRICKS];
+  int32_t brick_h[MAX_BRICKS];
+
+  explicit ClassicGames(int games);  // On the classic four bricks
+
+  int Count() const
+  {
+    return games;
+  }
+
+  // These bricks on a width x height field instead. False when there are
+  // more than MAX_BRICKS
+  bool UseBricks(const BrickSoA& bricks, int width, int height);
+
+  void Reset(uint64_t seed);
+
+  // Up to ticks more ticks for every game still playing
+  void StepScalar(int ticks)
+  {
+    StepScalar(ticks, 0, games);
+  }
+
+  void StepSSE2(int ticks)
+  {
+    StepSSE2(ticks, 0, games);
+  }
+
+  void StepAVX2(int ticks)
+  {
+    StepAVX2(ticks, 0, games);
+  }
+
+  // Games [first, end) only, first a multiple of LANES
+  void StepScalar(int ticks, int first, int end);
+  void StepSSE2(int ticks, int first, int end);
+  void StepAVX2(int ticks, int first, int end);
+
+  // The widest of them BrickSoA::SelectedKernel() allows
+  void Step(int ticks);
+
+  // BLOCK games at a time on the pool's threads, with kernel one of
+  // BrickSoA::Kernel. Leaves the same states as stepping on one thread
+  void Step(WorkStealingPool& pool, int kernel, int ticks);
+
+  uint64_t Hash(int game) const;
+
+  ~ClassicGames();
+
+private:
+  int games;
+
+  int BandTop() const;
+  int BandBottom() const;
+  void StepKernel(int kernel, int ticks, int first, int end);
+};
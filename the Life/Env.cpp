@@ -0,0 +1,161 @@
+#include "Env.h"
+
+#include "ArkEnv.h"
+
+VecEnv::VecEnv(int count, int threads)
+  : envs(count), pool(threads)
+{
+  max_ticks = 20000;
+}
+
+const char* VecEnv::SetLevel(std::shared_ptr<const LevelFile> file)
+{
+  const char* error = file->Check(true);
+  size_t i;
+
+  if (error != NULL)
+    return error;
+
+  for (i = 0; i < envs.size(); i++)
+    envs[i].game.SetLevel(file, false);
+
+  return NULL;
+}
+
+// The ball moved up to 100 pixels either way and sent either way
+void VecEnv::Start(Env& env)
+{
+  Game& game = env.game;
+
+  game.Reset();
+  game.ball.pos_x += (float)env.random.Below(201) - 100;
+  if (env.random.Below(2) == 0)
+    game.directionX = -game.directionX;
+
+  env.remaining = game.bricks.Remaining();
+}
+
+void VecEnv::Observe(const Env& env, float* out) const
+{
+  const Game& game = env.game;
+
+  out[0] = (game.ball.pos_x + game.ball.radius) / game.width;
+  out[1] = (game.ball.pos_y + game.ball.radius) / game.height;
+  out[2] = game.directionX * game.ball.speed_x / 1000;
+  out[3] = game.directionY * game.ball.speed_y / 1000;
+  out[4] = (game.paddle.pos_x + game.paddle.weight * 0.5f) / game.width;
+  out[5] = game.bricks.Count() > 0 ? (float)env.remaining / game.bricks.Count() : 0.0f;
+}
+
+void VecEnv::Reset(uint64_t seed, float* observations)
+{
+  int blocks = (Count() + BLOCK - 1) / BLOCK;
+
+  pool.Run(blocks, [&](int block, int)
+  {
+    int i, last = std::min(Count(), (block + 1) * BLOCK);
+
+    for (i = block * BLOCK; i < last; i++)
+    {
+      envs[i].random.Seed(seed, (uint64_t)i);
+      Start(envs[i]);
+      Observe(envs[i], observations + (size_t)i * OBSERVATION_SIZE);
+    }
+  });
+}
+
+void VecEnv::Step(const int* actions, float* observations, float* rewards, uint8_t* dones)
+{
+  int blocks = (Count() + BLOCK - 1) / BLOCK;
+
+  pool.Run(blocks, [&](int block, int)
+  {
+    GameInput input;
+    int i, now, last = std::min(Count(), (block + 1) * BLOCK);
+
+    input.spawn = 0;
+
+    for (i = block * BLOCK; i < last; i++)
+    {
+      Env& env = envs[i];
+      Game& game = env.game;
+
+      input.move = actions[i] < 0 ? -1 : actions[i] > 0 ? 1 : 0;
+      game.Step(input);
+
+      now = game.bricks.Remaining();
+      rewards[i] = (float)(env.remaining - now) - (game.result == Game::LOSE ? 1 : 0);
+      env.remaining = now;
+
+      dones[i] = game.result != Game::PLAYING || game.ticks >= max_ticks;
+      if (dones[i])
+        Start(env);
+
+      Observe(env, observations + (size_t)i * OBSERVATION_SIZE);
+    }
+  });
+}
+
+VecEnv::~VecEnv()
+{
+}
+
+struct ArkEnv
+{
+  VecEnv env;
+
+  ArkEnv(int count, int threads)
+    : env(count, threads)
+  {
+  }
+};
+
+ArkEnv* ArkEnvCreate(int count, int threads, const char* level_path)
+{
+  std::shared_ptr<LevelFile> level;
+  std::unique_ptr<ArkEnv> env;
+
+  if (count <= 0)
+    return NULL;
+
+  // The allocations throw, C callers can't catch
+  try
+  {
+    if (level_path != NULL)
+    {
+      level = std::make_shared<LevelFile>();
+      if (!level->Map(level_path) && !level->Read(level_path))
+        return NULL;
+    }
+
+    env.reset(new ArkEnv(count, threads));
+    if (level && env->env.SetLevel(level) != NULL)
+      return NULL;
+  }
+  catch (...)
+  {
+    return NULL;
+  }
+
+  return env.release();
+}
+
+int ArkEnvObservationSize(void)
+{
+  return VecEnv::OBSERVATION_SIZE;
+}
+
+void ArkEnvReset(ArkEnv* env, uint64_t seed, float* observations)
+{
+  env->env.Reset(seed, observations);
+}
+
+void ArkEnvStep(ArkEnv* env, const int* actions, float* observations, float* rewards, uint8_t* dones)
+{
+  env->env.Step(actions, observations, rewards, dones);
+}
+
+void ArkEnvDestroy(ArkEnv* env)
+{
+  delete env;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+// Many games as one environment, for training paddle controllers far
+// faster than a window allows. Reset starts every game, Step moves each
+// one a tick with its own action and fills caller-owned buffers:
+//
+//   observations   count * OBSERVATION_SIZE floats, per game
+//                  ball x, y (0 .. 1 of the field), ball speed x, y
+//                  (signed, 1000 pixels per second = 1), paddle middle x
+//                  (0 .. 1), share of the bricks still standing
+//   rewards        count floats: bricks destroyed this tick, -1 on a loss
+//   dones          count bytes: 1 when the game ended this tick, won, lost
+//                  or out of ticks
+//
+// A finished game starts over at once, so the observation after a done
+// is the first of the next game. Games are stepped in blocks across a
+// work stealing pool, each game on cache lines of its own, and Step
+// allocates nothing.
+//
+// The same is there for C as the ArkEnv functions in ArkEnv.h.
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "ArkEnv.h"
+#include "Game.h"
+#include "Generator.h"
+#include "Pool.h"
+
+class VecEnv
+{
+public:
+  enum
+  {
+    OBSERVATION_SIZE = 6,
+    BLOCK = 64            // Games a worker takes at a time
+  };
+
+  long long max_ticks;    // A game is done after this many
+
+  VecEnv(int count, int threads = 0);  // threads 0 for one per hardware thread
+
+  // Plays this level from the next Reset on, NULL for the classic one.
+  // Returns NULL on success, else what is wrong with the file
+  const char* SetLevel(std::shared_ptr<const LevelFile> file);
+
+  int Count() const
+  {
+    return (int)envs.size();
+  }
+
+  int Threads() const
+  {
+    return pool.Threads();
+  }
+
+  // Every game from its start. Game i takes its starting position from
+  // stream i of the seed, and so do all the games after it
+  void Reset(uint64_t seed, float* observations);
+
+  // actions: one per game, -1 left, 0 stay, 1 right
+  void Step(const int* actions, float* observations, float* rewards, uint8_t* dones);
+
+  ~VecEnv();
+
+private:
+  // No extra balls are ever launched, so no room is kept for them
+  struct alignas(64) Env
+  {
+    Env()
+      : game(0)
+    {
+    }
+
+    Game game;
+    Xoshiro256 random;
+    int remaining;        // Bricks standing after the last tick
+  };
+
+  std::vector<Env, AlignedAllocator<Env, 64> > envs;
+  WorkStealingPool pool;
+
+  void Start(Env& env);
+  void Observe(const Env& env, float* out) const;
+};
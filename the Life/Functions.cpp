@@ -1,7 +1,210 @@
 #include "Header.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+double ProcessCpuSeconds()
+{
+#ifdef _WIN32
+  FILETIME creation, exit, kernel, user;
+  ULARGE_INTEGER k, u;
+
+  if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+    return 0;
+
+  k.LowPart = kernel.dwLowDateTime;
+  k.HighPart = kernel.dwHighDateTime;
+  u.LowPart = user.dwLowDateTime;
+  u.HighPart = user.dwHighDateTime;
+
+  return (k.QuadPart + u.QuadPart) * 1e-7;  // 100 ns units
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+void SleepUntil(Uint64 deadline)
+{
+  Uint64 frequency = SDL_GetPerformanceFrequency();
+  Sint64 left;
+
+  while ((left = (Sint64)(deadline - SDL_GetPerformanceCounter())) > 0)
+  {
+    if (left >= (Sint64)(frequency / 1000))
+      SDL_Delay((Uint32)(left * 1000 / frequency));
+    else
+      SDL_Delay(0);  // Less than a millisecond left, just give up the time slice
+  }
+}
+
+std::shared_ptr<LevelFile> OpenLevel(const char* path)
+{
+  std::shared_ptr<LevelFile> file = std::make_shared<LevelFile>();
+  SDL_RWops* rw;
+  Sint64 size;
+
+  if (file->Map(path))
+    return file;
+
+  rw = SDL_RWFromFile(path, "rb");
+  if (rw == NULL)
+    return NULL;
+
+  size = SDL_RWsize(rw);
+  if (size <= 0 || SDL_RWread(rw, file->Allocate((size_t)size), 1, (size_t)size) != (size_t)size)
+    file.reset();
+  SDL_RWclose(rw);
+
+  return file;
+}
+
+GeometryBatch::GeometryBatch()
+{
+  draw_calls = 0;
+}
+
+void GeometryBatch::AddQuad(SDL_Texture* texture, const SDL_Rect& rect, SDL_Color color)
+{
+  SDL_Vertex vertex;
+  size_t g;
+  int base;
+
+  for (g = 0; g < groups.size(); g++)
+    if (groups[g].texture == texture)
+      break;
+
+  if (g == groups.size())
+  {
+    groups.push_back(Group());
+    groups[g].texture = texture;
+  }
+
+  Group& group = groups[g];
+  if (group.vertices.empty())
+    order.push_back((int)g);
+
+  base = (int)group.vertices.size();
+  vertex.color = color;
+
+  vertex.position.x = (float)rect.x;
+  vertex.position.y = (float)rect.y;
+  vertex.tex_coord.x = 0.0f;
+  vertex.tex_coord.y = 0.0f;
+  group.vertices.push_back(vertex);
+
+  vertex.position.x = (float)(rect.x + rect.w);
+  vertex.tex_coord.x = 1.0f;
+  group.vertices.push_back(vertex);
+
+  vertex.position.y = (float)(rect.y + rect.h);
+  vertex.tex_coord.y = 1.0f;
+  group.vertices.push_back(vertex);
+
+  vertex.position.x = (float)rect.x;
+  vertex.tex_coord.x = 0.0f;
+  group.vertices.push_back(vertex);
+
+  // Two triangles: 0 1 2 and 0 2 3
+  group.indices.push_back(base);
+  group.indices.push_back(base + 1);
+  group.indices.push_back(base + 2);
+  group.indices.push_back(base);
+  group.indices.push_back(base + 2);
+  group.indices.push_back(base + 3);
+}
+
+void GeometryBatch::Flush(SDL_Renderer* renderer)
+{
+  size_t k;
+
+  draw_calls = 0;
+
+  for (k = 0; k < order.size(); k++)
+  {
+    Group& group = groups[order[k]];
+
+    SDL_RenderGeometry(renderer, group.texture, &group.vertices[0], (int)group.vertices.size(),
+                       &group.indices[0], (int)group.indices.size());
+    draw_calls++;
+
+    group.vertices.clear();
+    group.indices.clear();
+  }
+
+  order.clear();
+}
+
+GeometryBatch::~GeometryBatch()
+{
+}
 
 Circle::Circle() // Constructor
 {
+  radius = 10;
+  color.r = 255;
+  color.g = 255;
+  color.b = 255;
+  color.a = 255;
+
+  texture = NULL;
+  texture_renderer = NULL;
+  texture_radius = 0;
+  texture_color = color;
+}
+
+void Circle::Rasterize(SDL_Renderer* renderer)
+{
+  SDL_Surface* surface;
+  Uint32* pixels;
+  Uint32 inside, outside;
+  int i, j, size;
+
+  Release();
+
+  size = 2 * radius;
+  surface = SDL_CreateRGBSurfaceWithFormat(0, size, size, 32, SDL_PIXELFORMAT_RGBA32);
+  if (surface == NULL)
+    return;
+
+  inside = SDL_MapRGBA(surface->format, color.r, color.g, color.b, color.a);
+  outside = SDL_MapRGBA(surface->format, 0, 0, 0, 0);
+
+  // Same coverage test the per-pixel version used: i * i + j * j <= r * r
+  SDL_LockSurface(surface);
+  for (j = -radius; j < radius; j++)
+  {
+    pixels = (Uint32*)((Uint8*)surface->pixels + (j + radius) * surface->pitch);
+    for (i = -radius; i < radius; i++)
+      pixels[i + radius] = (i * i + j * j <= radius * radius) ? inside : outside;
+  }
+  SDL_UnlockSurface(surface);
+
+  texture = SDL_CreateTextureFromSurface(renderer, surface);
+  SDL_FreeSurface(surface);
+
+  if (texture != NULL)
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+
+  texture_renderer = renderer;
+  texture_radius = radius;
+  texture_color = color;
+}
+
+void Circle::Release()
+{
+  if (texture != NULL)
+    SDL_DestroyTexture(texture);
+
+  texture = NULL;
+  texture_renderer = NULL;
 }
 
 Circle::~Circle() // Destructor
@@ -16,10 +219,317 @@ Platform::~Platform()
 {
 }
 
-Brick::Brick()
+BrickBatch::BrickBatch()
+{
+  dirty = true;
+}
+
+void BrickBatch::Rebuild(const BrickSoA& bricks)
+{
+  Uint32 key, last = 0;
+  size_t k;
+  int i;
+
+  keys.clear();
+  colors.clear();
+  starts.clear();
+  rects.clear();
+
+  bricks.ForEachAlive([&](int i) { keys.push_back((Uint64)bricks.color[i] << 32 | (Uint32)i); });
+
+  // Sorting by color keeps each group contiguous and in brick order
+  std::sort(keys.begin(), keys.end());
+
+  for (k = 0; k < keys.size(); k++)
+  {
+    SDL_Rect rect;
+
+    i = (int)(Uint32)keys[k];
+    key = (Uint32)(keys[k] >> 32);
+    if (k == 0 || key != last)
+    {
+      SDL_Color color = { (Uint8)(key >> 24), (Uint8)(key >> 16), (Uint8)(key >> 8), (Uint8)key };
+      colors.push_back(color);
+      starts.push_back((int)rects.size());
+      last = key;
+    }
+
+    rect.x = bricks.pos_x[i];
+    rect.y = bricks.pos_y[i];
+    rect.w = bricks.weight[i];
+    rect.h = bricks.hight[i];
+    rects.push_back(rect);
+  }
+  starts.push_back((int)rects.size());
+
+  dirty = false;
+}
+
+BrickBatch::~BrickBatch()
+{
+}
+
+BrickLayer::BrickLayer()
+{
+  lost = false;
+  redrawn = false;
+  texture = NULL;
+  texture_renderer = NULL;
+  texture_w = 0;
+  texture_h = 0;
+  texture_version = -1;
+}
+
+bool BrickLayer::Update(SDL_Renderer* renderer, const BrickSoA& bricks, int version)
+{
+  uint64_t gone;
+  size_t w;
+  int i, width, height;
+
+  holes.clear();
+  redrawn = false;
+
+  if (!SDL_RenderTargetSupported(renderer) || SDL_GetRendererOutputSize(renderer, &width, &height) != 0)
+    return false;
+
+  if (texture == NULL || texture_renderer != renderer || width != texture_w || height != texture_h ||
+      lost || drawn.size() != bricks.live.size())
+  {
+    Redraw(renderer, bricks, version, width, height);
+    return texture != NULL;
+  }
+
+  if (version == texture_version)
+    return true;
+
+  for (w = 0; w < drawn.size(); w++)
+  {
+    // A brick that came back can't be patched in under its neighbours' holes
+    if ((bricks.live[w] & ~drawn[w]) != 0)
+    {
+      holes.clear();
+      Redraw(renderer, bricks, version, width, height);
+      return texture != NULL;
+    }
+
+    for (gone = drawn[w] & ~bricks.live[w]; gone != 0; gone &= gone - 1)
+    {
+      SDL_Rect rect;
+
+      i = (int)(w * 64 + CountTrailingZeros64(gone));
+      rect.x = bricks.pos_x[i];
+      rect.y = bricks.pos_y[i];
+      rect.w = bricks.weight[i];
+      rect.h = bricks.hight[i];
+      holes.push_back(rect);
+    }
+  }
+
+  if (!holes.empty())
+  {
+    SDL_SetRenderTarget(renderer, texture);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderFillRects(renderer, &holes[0], (int)holes.size());
+    SDL_SetRenderTarget(renderer, NULL);
+  }
+
+  drawn = bricks.live;
+  texture_version = version;
+
+  return true;
+}
+
+void BrickLayer::Redraw(SDL_Renderer* renderer, const BrickSoA& bricks, int version, int width, int height)
+{
+  // A lost texture may be gone with its device, so it is made anew too
+  if (texture == NULL || texture_renderer != renderer || width != texture_w || height != texture_h || lost)
+  {
+    Release();
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, width, height);
+    if (texture == NULL)
+      return;
+
+    texture_renderer = renderer;
+    texture_w = width;
+    texture_h = height;
+  }
+
+  SDL_SetRenderTarget(renderer, texture);
+  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+  SDL_RenderClear(renderer);
+
+  batch.Rebuild(bricks);
+  batch.Draw(geometry);
+  geometry.Flush(renderer);
+
+  SDL_SetRenderTarget(renderer, NULL);
+
+  drawn = bricks.live;
+  texture_version = version;
+  lost = false;
+  redrawn = true;
+}
+
+void BrickLayer::Release()
+{
+  if (texture != NULL)
+    SDL_DestroyTexture(texture);
+
+  texture = NULL;
+  texture_renderer = NULL;
+}
+
+BrickLayer::~BrickLayer()
+{
+}
+
+DirtyRects::DirtyRects()
 {
+  width = 0;
+  height = 0;
+  rects.reserve(MAX_RECTS);
 }
 
-Brick::~Brick()
+void DirtyRects::SetBounds(int w, int h)
 {
+  width = w;
+  height = h;
+}
+
+void DirtyRects::Add(const SDL_Rect& rect)
+{
+  SDL_Rect screen = { 0, 0, width, height };
+  SDL_Rect merged, both;
+  long long growth, least = 0;
+  size_t k, best = 0;
+
+  if (!SDL_IntersectRect(&rect, &screen, &merged))
+    return;
+
+  // Whatever it touches is folded in, and what that grew into may touch more
+  for (k = 0; k < rects.size(); )
+  {
+    if (SDL_HasIntersection(&merged, &rects[k]))
+    {
+      SDL_UnionRect(&merged, &rects[k], &merged);
+      rects[k] = rects.back();
+      rects.pop_back();
+      k = 0;
+    }
+    else
+      k++;
+  }
+
+  if (rects.size() < MAX_RECTS)
+  {
+    rects.push_back(merged);
+    return;
+  }
+
+  // Full: into the rect whose area grows least
+  for (k = 0; k < rects.size(); k++)
+  {
+    SDL_UnionRect(&merged, &rects[k], &both);
+    growth = (long long)both.w * both.h - (long long)rects[k].w * rects[k].h;
+    if (k == 0 || growth < least)
+    {
+      least = growth;
+      best = k;
+    }
+  }
+
+  SDL_UnionRect(&merged, &rects[best], &both);
+  rects[best] = rects.back();
+  rects.pop_back();
+  Add(both);
+}
+
+long long DirtyRects::Pixels() const
+{
+  long long n = 0;
+  size_t k;
+
+  for (k = 0; k < rects.size(); k++)
+    n += (long long)rects[k].w * rects[k].h;
+
+  return n;
+}
+
+DirtyRects::~DirtyRects()
+{
+}
+
+SDL_Rect ParticleBounds(const ParticlePool& particles)
+{
+  SDL_Rect rect = { 0, 0, 0, 0 };
+  float x0 = 1e9f, y0 = 1e9f, x1 = -1e9f, y1 = -1e9f;
+
+  if (particles.Count() == 0)
+    return rect;
+
+  particles.ForEach([&](int i)
+  {
+    x0 = std::min(x0, particles.pos_x[i]);
+    x1 = std::max(x1, particles.pos_x[i]);
+    y0 = std::min(y0, particles.pos_y[i]);
+    y1 = std::max(y1, particles.pos_y[i]);
+  });
+
+  // Same rounding as DrawParticles, and its 3 pixel quads
+  rect.x = (int)std::max(x0, -1e6f);
+  rect.y = (int)std::max(y0, -1e6f);
+  rect.w = (int)std::min(x1, 1e6f) - rect.x + 3;
+  rect.h = (int)std::min(y1, 1e6f) - rect.y + 3;
+
+  return rect;
+}
+
+void DrawParticles(const ParticlePool& particles, GeometryBatch& batch)
+{
+  particles.ForEach([&](int i)
+  {
+    Uint32 rgba = particles.color[i];
+    float fade = 1.0f - particles.age[i] / particles.lifetime;
+    SDL_Rect rect = { (int)particles.pos_x[i], (int)particles.pos_y[i], 3, 3 };
+    SDL_Color color = { (Uint8)((rgba >> 24) * fade), (Uint8)((rgba >> 16 & 0xFF) * fade),
+                        (Uint8)((rgba >> 8 & 0xFF) * fade), 255 };
+
+    batch.AddRect(rect, color);
+  });
+}
+
+SDL_Rect DrawTiming(const FrameTimer& timer, Uint64 budget_ns, GeometryBatch& batch)
+{
+  const int left = 8, top = 8, width = 400, row = 8;
+  const SDL_Color colors[4] = { { 110, 0, 0, 255 }, { 220, 80, 0, 255 }, { 220, 200, 0, 255 }, { 0, 190, 0, 255 } };
+  SDL_Rect area = { left - 2, top - 2, width + 4, PHASE_COUNT * row + 2 };
+  SDL_Rect bar;
+  Uint64 values[4];
+  int i, k;
+
+  batch.AddRect(area, { 24, 24, 24, 255 });
+
+  for (i = 0; i < PHASE_COUNT; i++)
+  {
+    const FrameTimer::Summary& phase = timer.shown[i];
+
+    values[0] = phase.max;
+    values[1] = phase.p99;
+    values[2] = phase.p95;
+    values[3] = phase.p50;
+
+    // Longest first so the shorter ones stay visible on top
+    for (k = 0; k < 4; k++)
+    {
+      bar = { left, top + i * row, (int)std::min<Uint64>(width, values[k] * (width / 4) / budget_ns), row - 2 };
+      if (bar.w == 0 && values[k] > 0)
+        bar.w = 1;
+      batch.AddRect(bar, colors[k]);
+    }
+  }
+
+  bar = { left + width / 4, top - 2, 1, PHASE_COUNT * row + 2 };
+  batch.AddRect(bar, { 255, 255, 255, 255 });
+
+  return area;
 }
@@ -0,0 +1,521 @@
+#include "Game.h"
+
+#include <math.h>
+
+// Where a moving circle first touches something during one tick
+struct Contact
+{
+  float t;      // Fraction of the move, 0..1
+  float nx;     // Surface normal at the contact
+  float ny;
+  int what;     // CONTACT_* or the brick index
+};
+
+enum
+{
+  CONTACT_NONE = -1,
+  CONTACT_WALL = -2,
+  CONTACT_PADDLE = -3
+};
+
+// Swept circle against an axis aligned box: the box grown by the radius is
+// tested with a ray, and near the corners the ray is tested against a
+// circle around the corner instead. A circle that already overlaps the box
+// touches it at t = 0, if it is moving inwards: with the normal from the
+// nearest point of the box, or of the shallowest side when its center is
+// inside. Only contacts earlier than contact.t replace it.
+static void SweepCircleBox(float cx, float cy, float r, float dx, float dy,
+                           float x0, float y0, float x1, float y1, int what, Contact& contact)
+{
+  float tx0, tx1, ty0, ty1, enter, leave, t, nx, ny;
+  float px, py, kx, ky, mx, my, a, b, c, disc;
+  float left, right, top, bottom, distance;
+
+  // Already overlapping: the nearest point of the box is within the
+  // radius. The grown box's square corners are not, the rounded corner
+  // solve below takes those
+  px = fminf(fmaxf(cx, x0), x1);
+  py = fminf(fmaxf(cy, y0), y1);
+  mx = cx - px;
+  my = cy - py;
+  distance = mx * mx + my * my;
+  if (distance < r * r)
+  {
+    nx = 0;
+    ny = 0;
+    if (distance > 0)
+    {
+      distance = sqrtf(distance);
+      nx = mx / distance;
+      ny = my / distance;
+    }
+    else
+    {
+      left = cx + r - x0;
+      right = x1 - (cx - r);
+      top = cy + r - y0;
+      bottom = y1 - (cy - r);
+
+      if (fminf(left, right) < fminf(top, bottom))
+        nx = left < right ? -1.0f : 1.0f;
+      else
+        ny = top < bottom ? -1.0f : 1.0f;
+    }
+
+    if (dx * nx + dy * ny < 0 && contact.t > 0)
+    {
+      contact.t = 0;
+      contact.nx = nx;
+      contact.ny = ny;
+      contact.what = what;
+    }
+    return;
+  }
+
+  if (dx == 0)
+  {
+    if (cx <= x0 - r || cx >= x1 + r)
+      return;
+    tx0 = -INFINITY;
+    tx1 = INFINITY;
+  }
+  else
+  {
+    tx0 = (x0 - r - cx) / dx;
+    tx1 = (x1 + r - cx) / dx;
+    if (tx0 > tx1)
+    {
+      t = tx0;
+      tx0 = tx1;
+      tx1 = t;
+    }
+  }
+
+  if (dy == 0)
+  {
+    if (cy <= y0 - r || cy >= y1 + r)
+      return;
+    ty0 = -INFINITY;
+    ty1 = INFINITY;
+  }
+  else
+  {
+    ty0 = (y0 - r - cy) / dy;
+    ty1 = (y1 + r - cy) / dy;
+    if (ty0 > ty1)
+    {
+      t = ty0;
+      ty0 = ty1;
+      ty1 = t;
+    }
+  }
+
+  enter = fmaxf(tx0, ty0);
+  leave = fminf(tx1, ty1);
+  if (enter > leave || leave <= 0)
+    return;
+
+  // Starting inside the grown box but clear of the box itself can only
+  // mean a corner region, the rounded corner solve takes it from there
+  if (enter < 0)
+    enter = 0;
+  if (enter >= contact.t)
+    return;
+
+  px = cx + dx * enter;
+  py = cy + dy * enter;
+
+  if ((px < x0 || px > x1) && (py < y0 || py > y1))
+  {
+    // Rounded corner: solve |p + d t - k| = r for the corner k
+    kx = px < x0 ? x0 : x1;
+    ky = py < y0 ? y0 : y1;
+    mx = cx - kx;
+    my = cy - ky;
+    a = dx * dx + dy * dy;
+    b = mx * dx + my * dy;
+    c = mx * mx + my * my - r * r;
+    disc = b * b - a * c;
+    if (disc < 0 || b >= 0)
+      return;
+
+    t = (-b - sqrtf(disc)) / a;
+    if (t < 0 || t >= contact.t)
+      return;
+
+    nx = (mx + dx * t) / r;
+    ny = (my + dy * t) / r;
+  }
+  else
+  {
+    t = enter;
+    nx = 0;
+    ny = 0;
+    if (tx0 > ty0)
+      nx = dx > 0 ? -1.0f : 1.0f;
+    else
+      ny = dy > 0 ? -1.0f : 1.0f;
+  }
+
+  if (dx * nx + dy * ny >= 0) // Touching but moving away
+    return;
+
+  contact.t = t;
+  contact.nx = nx;
+  contact.ny = ny;
+  contact.what = what;
+}
+
+// Swept circle against a wall at x or y = position, open on the side the
+// ball is on
+static void SweepCircleWall(float c, float r, float d, float position, float normal, Contact& contact, bool vertical)
+{
+  float t;
+
+  if (d * normal >= 0) // Moving away
+    return;
+
+  t = (position + normal * r - c) / d;
+  if (t < 0)
+    t = 0;  // Already past it
+  if (t >= contact.t)
+    return;
+
+  contact.t = t;
+  contact.nx = vertical ? normal : 0;
+  contact.ny = vertical ? 0 : normal;
+  contact.what = CONTACT_WALL;
+}
+
+GameSnapshot::GameSnapshot()
+{
+  // Zero until the first snapshot, the renderer may lerp before any tick
+  ball = Ball();
+  previous_ball = Ball();
+  paddle = Paddle();
+  previous_paddle = Paddle();
+  bricks_version = -1;
+  result = Game::PLAYING;
+  ticks = 0;
+  tick_time = 0;
+}
+
+Game::Game(int max_balls)
+{
+  bricks_version = 0;
+  balls.Reserve(max_balls);
+  SetTickRate(120);
+  Reset();
+}
+
+void Game::SetTickRate(int hz)
+{
+  tick_rate = hz;
+  tick_seconds = 1.0f / hz;
+}
+
+void Game::ClearBricks()
+{
+  bricks.Clear();
+  bricks_version++;
+}
+
+void Game::BuildGrid()
+{
+  grid.Build(bricks);
+  candidates.resize(bricks.Count() < SCAN_LIMIT ? bricks.Count() : SCAN_LIMIT);
+  bricks_version++;
+}
+
+void Game::AddBrick(int x, int y, int w, int h, uint32_t color)
+{
+  bricks.Add(x, y, w, h, color);
+}
+
+void Game::Reset()
+{
+  width = level ? (int)level->Header().width : 640;
+  height = level ? (int)level->Header().height : 480;
+
+  // 10 pixels per 30 ms timer tick, as the game always moved. Placed
+  // from the bottom middle, where they were on the 640 x 480 screen
+  ball.pos_x = width / 2 - 60.0f;
+  ball.pos_y = height - 180.0f;
+  ball.speed_x = 1000.0f / 3;
+  ball.speed_y = 1000.0f / 3;
+  ball.radius = 10;
+
+  paddle.hight = 20;
+  paddle.weight = 200;
+  paddle.pos_x = (width - paddle.weight) / 2.0f;
+  paddle.pos_y = height - 50.0f;
+  paddle.speed_x = 400;
+
+  balls.Clear();
+
+  if (level)
+    UseLevel(level, bricks);  // In place, no copy of the bricks
+  else
+  {
+    ClearBricks();
+    AddBrick(10, 10, 150, 70, 0xFF00FFFF);
+    AddBrick(170, 10, 150, 70, 0xFF00FFFF);
+    AddBrick(330, 10, 150, 70, 0xFF00FFFF);
+    AddBrick(490, 10, 140, 70, 0xFF00FFFF);
+  }
+  BuildGrid();
+
+  directionX = 1;
+  directionY = 1;
+  ticks = 0;
+  result = PLAYING;
+}
+
+const char* Game::SetLevel(std::shared_ptr<const LevelFile> file, bool checksum)
+{
+  const char* error = file->Check(checksum);
+
+  if (error != NULL)
+    return error;
+
+  level = file;
+  Reset();
+
+  return NULL;
+}
+
+void Game::KillBrick(int i)
+{
+  bricks.Kill(i);
+  grid.Remove(bricks, i);
+  bricks_version++;
+}
+
+void Game::SweepBrick(int i, float cx, float cy, float r, float dx, float dy, Contact& contact) const
+{
+  SweepCircleBox(cx, cy, r, dx, dy, (float)bricks.pos_x[i], (float)bricks.pos_y[i],
+                 (float)(bricks.pos_x[i] + bricks.weight[i]), (float)(bricks.pos_y[i] + bricks.hight[i]), i, contact);
+}
+
+// Moves the ball through one tick, bouncing off every wall, paddle side
+// and brick it touches on the way, in time order
+void Game::MoveBall()
+{
+  float r = ball.radius;
+  float cx = ball.pos_x + r;
+  float cy = ball.pos_y + r;
+  float left = 1;  // Part of the tick still to move
+  float dx, dy, x0, y0, x1, y1;
+  int bounces, found, k;
+  Contact contact;
+
+  for (bounces = 0; bounces < 16 && left > 0; bounces++)
+  {
+    dx = directionX * ball.speed_x * tick_seconds * left;
+    dy = directionY * ball.speed_y * tick_seconds * left;
+
+    contact.t = 1;
+    contact.what = CONTACT_NONE;
+
+    SweepCircleWall(cx, r, dx, 0, 1, contact, true);
+    SweepCircleWall(cx, r, dx, (float)width, -1, contact, true);
+    SweepCircleWall(cy, r, dy, 0, 1, contact, false);
+
+    SweepCircleBox(cx, cy, r, dx, dy, paddle.pos_x, paddle.pos_y,
+                   paddle.pos_x + paddle.weight, paddle.pos_y + paddle.hight, CONTACT_PADDLE, contact);
+
+    // Only the bricks this move's bounds overlap get the exact test
+    x0 = fminf(cx, cx + dx) - r;
+    y0 = fminf(cy, cy + dy) - r;
+    x1 = fmaxf(cx, cx + dx) + r;
+    y1 = fmaxf(cy, cy + dy) + r;
+
+    if (bricks.Count() <= SCAN_LIMIT)
+    {
+      found = bricks.FindOverlaps(0, bricks.Count(), (int)floorf(x0), (int)floorf(y0),
+                                  (int)ceilf(x1), (int)ceilf(y1), candidates.data());
+      for (k = 0; k < found; k++)
+        SweepBrick(candidates[k], cx, cy, r, dx, dy, contact);
+    }
+    else
+      grid.Query(x0, y0, x1, y1, [&](int i) { SweepBrick(i, cx, cy, r, dx, dy, contact); });
+
+    cx += dx * contact.t;
+    cy += dy * contact.t;
+    left *= 1 - contact.t;
+
+    if (contact.what == CONTACT_NONE)
+      break;
+
+    // Bounce along the axis the contact faces most, or both if that
+    // still leaves the ball moving into the surface
+    if (fabsf(contact.nx) >= fabsf(contact.ny))
+      directionX = contact.nx > 0 ? 1 : -1;
+    else
+      directionY = contact.ny > 0 ? 1 : -1;
+
+    if (directionX * ball.speed_x * contact.nx + directionY * ball.speed_y * contact.ny < 0)
+    {
+      if (contact.nx != 0)
+        directionX = contact.nx > 0 ? 1 : -1;
+      if (contact.ny != 0)
+        directionY = contact.ny > 0 ? 1 : -1;
+    }
+
+    // The paddle always sends the ball up, unless it is already below it
+    if (contact.what == CONTACT_PADDLE && cy < paddle.pos_y + paddle.hight)
+      directionY = -1;
+
+    if (contact.what >= 0)
+      KillBrick(contact.what);
+  }
+
+  ball.pos_x = cx - r;
+  ball.pos_y = cy - r;
+}
+
+int Game::SpawnBalls(int n)
+{
+  float speed = sqrtf(ball.speed_x * ball.speed_x + ball.speed_y * ball.speed_y);
+  float angle;
+  int k;
+
+  // Evenly from 60 degrees left of straight up to 60 degrees right
+  for (k = 0; k < n; k++)
+  {
+    angle = (n == 1 ? 0.0f : (k / (n - 1.0f) - 0.5f) * 2.0944f);
+    if (!balls.Spawn(ball.pos_x, ball.pos_y, speed * sinf(angle), -speed * cosf(angle), ball.radius))
+      break;
+  }
+
+  return k;
+}
+
+static bool Overlaps(float x0, float y0, float x1, float y1, const BrickSoA& bricks, int i)
+{
+  return x0 < bricks.pos_x[i] + bricks.weight[i] && x1 > bricks.pos_x[i] &&
+         y0 < bricks.pos_y[i] + bricks.hight[i] && y1 > bricks.pos_y[i];
+}
+
+// The extra balls: the pool moves them and bounces them off the walls
+// all at once, then each is checked against the paddle and the bricks
+// where it ended up. They move a few pixels a tick, far less than a
+// brick, so that is enough for them
+void Game::MoveBalls()
+{
+  float x0, y0, x1, y1, depth_x, depth_y;
+  int i, k, found, hit;
+
+  balls.Integrate(tick_seconds, (float)width, (float)height);
+
+  for (i = 0; i < balls.Count(); i++)
+  {
+    x0 = balls.pos_x[i];
+    y0 = balls.pos_y[i];
+    x1 = x0 + 2 * balls.radius[i];
+    y1 = y0 + 2 * balls.radius[i];
+
+    // The paddle always sends it up
+    if (balls.speed_y[i] > 0 && x1 > paddle.pos_x && x0 < paddle.pos_x + paddle.weight &&
+        y1 > paddle.pos_y && y0 < paddle.pos_y + paddle.hight)
+      balls.speed_y[i] = -balls.speed_y[i];
+
+    if (!grid.Near(x0, y0, x1, y1))
+      continue;
+
+    // One brick per tick, the first one it overlaps
+    hit = -1;
+    if (bricks.Count() <= SCAN_LIMIT)
+    {
+      found = bricks.FindOverlaps(0, bricks.Count(), (int)floorf(x0), (int)floorf(y0),
+                                  (int)ceilf(x1), (int)ceilf(y1), candidates.data());
+      for (k = 0; k < found && hit < 0; k++)
+        if (Overlaps(x0, y0, x1, y1, bricks, candidates[k]))
+          hit = candidates[k];
+    }
+    else
+      grid.Query(x0, y0, x1, y1, [&](int b) {
+        if (hit < 0 && Overlaps(x0, y0, x1, y1, bricks, b))
+          hit = b;
+      });
+
+    if (hit < 0)
+      continue;
+
+    // Bounce off the side it went in least
+    depth_x = fminf(x1 - bricks.pos_x[hit], bricks.pos_x[hit] + bricks.weight[hit] - x0);
+    depth_y = fminf(y1 - bricks.pos_y[hit], bricks.pos_y[hit] + bricks.hight[hit] - y0);
+    if (depth_x < depth_y)
+      balls.speed_x[i] = (x0 + x1 < 2 * bricks.pos_x[hit] + bricks.weight[hit] ? -1 : 1) * fabsf(balls.speed_x[i]);
+    else
+      balls.speed_y[i] = (y0 + y1 < 2 * bricks.pos_y[hit] + bricks.hight[hit] ? -1 : 1) * fabsf(balls.speed_y[i]);
+
+    KillBrick(hit);
+  }
+}
+
+// The ball fell, the last extra ball becomes the ball
+void Game::TakeBall()
+{
+  int last = balls.Count() - 1;
+
+  ball.pos_x = balls.pos_x[last];
+  ball.pos_y = balls.pos_y[last];
+  ball.speed_x = fabsf(balls.speed_x[last]);
+  ball.speed_y = fabsf(balls.speed_y[last]);
+  ball.radius = balls.radius[last];
+  directionX = balls.speed_x[last] < 0 ? -1 : 1;
+  directionY = balls.speed_y[last] < 0 ? -1 : 1;
+  balls.Kill(last);
+}
+
+int Game::Step(const GameInput& input)
+{
+  if (result != PLAYING)
+    return result;
+
+  if (input.spawn > 0)
+    SpawnBalls(input.spawn);
+
+  // Moving the ractangle, kept inside the screen
+  paddle.pos_x += input.move * paddle.speed_x * tick_seconds;
+  if (paddle.pos_x < 0)
+    paddle.pos_x = 0;
+  if (paddle.pos_x > width - paddle.weight)
+    paddle.pos_x = width - paddle.weight;
+
+  MoveBall();
+  MoveBalls();
+
+  ticks++;
+
+  // The ball fell past the bottom of the screen, and no other is left
+  if (ball.pos_y + 2 * ball.radius >= height && balls.Count() > 0)
+    TakeBall();
+  if (ball.pos_y + 2 * ball.radius >= height)
+    result = LOSE;
+  else if (!bricks.AnyAlive())
+    result = WIN;
+
+  return result;
+}
+
+void Game::Snapshot(GameSnapshot& snapshot) const
+{
+  snapshot.ball = ball;
+  snapshot.paddle = paddle;
+  snapshot.balls.CopyFrom(balls);
+  snapshot.result = result;
+  snapshot.ticks = ticks;
+
+  // The slot may be two publishes old, so compare with its own version
+  if (snapshot.bricks_version != bricks_version)
+  {
+    snapshot.bricks = bricks;
+    snapshot.bricks_version = bricks_version;
+  }
+}
+
+Game::~Game()
+{
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+// Game simulation without SDL: the state that used to be global in
+// Source.cpp and the physics from my_callbackfunc and the main loop.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "Balls.h"
+#include "Bricks.h"
+#include "Grid.h"
+#include "Level.h"
+
+// Player input for one tick
+struct GameInput
+{
+  int move;   // -1 left, 0 stay, 1 right
+  int spawn;  // Extra balls to launch from the ball
+};
+
+class Ball
+{
+public:
+  float pos_x;    // Top left corner of the ball's box
+  float pos_y;
+  float speed_x;  // Pixels per second
+  float speed_y;
+  float radius;
+};
+
+class Paddle
+{
+public:
+  float pos_x;
+  float pos_y;
+  int hight;
+  int weight;
+  float speed_x;  // Pixels per second while a key is held
+};
+
+struct Contact;
+
+// Copy of what the renderer needs, handed from the simulation thread
+// to the main thread through a TripleBuffer
+class GameSnapshot
+{
+public:
+  Ball ball;
+  Ball previous_ball;          // State one tick earlier, for interpolation
+  Paddle paddle;
+  Paddle previous_paddle;
+  BallPool balls;              // Extra balls, not interpolated
+  BrickSoA bricks;             // Copied only when bricks_version changes
+  int bricks_version;
+  int result;
+  long long ticks;
+  uint64_t tick_time;          // When the current state is due, in the publisher's clock
+
+  GameSnapshot();
+};
+
+class Game
+{
+public:
+  enum Result
+  {
+    PLAYING,
+    WIN,
+    LOSE
+  };
+
+  int width;
+  int height;
+  int tick_rate;       // Ticks per second
+  float tick_seconds;
+
+  Ball ball;            // The one the game follows
+  BallPool balls;       // Extra balls, max_balls unless reserved otherwise
+  Paddle paddle;
+  BrickSoA bricks;
+
+  int directionX;
+  int directionY;
+  int bricks_version;    // Changes every time a brick is destroyed
+  long long ticks;
+  int result;
+
+  explicit Game(int max_balls = MAX_BALLS);
+
+  void Reset();  // The level from SetLevel, or the classic four bricks
+
+  // Plays this level file from now on. NULL on success, else what is
+  // wrong with the file and the level stays as it was. The checksum can
+  // be skipped for a file already checked
+  const char* SetLevel(std::shared_ptr<const LevelFile> file, bool checksum = true);
+
+  // The level file played, NULL for the classic level
+  const LevelFile* Level() const
+  {
+    return level.get();
+  }
+
+  // Building a level by hand: clear, add the bricks, then index them
+  void ClearBricks();
+  void AddBrick(int x, int y, int w, int h, uint32_t color);
+  void BuildGrid();
+
+  void SetTickRate(int hz);
+
+  // Launches up to n extra balls from the ball, fanned out upwards.
+  // Returns how many fit in the pool
+  int SpawnBalls(int n);
+
+  int Step(const GameInput& input);
+
+  void Snapshot(GameSnapshot& snapshot) const;
+
+  ~Game();
+
+  // Levels up to this size are scanned with the SIMD kernel, bigger
+  // ones go through the grid
+  enum { SCAN_LIMIT = 64 };
+
+  enum { MAX_BALLS = 4096 };
+
+private:
+  std::shared_ptr<const LevelFile> level;
+  BrickGrid grid;
+  std::vector<int> candidates;  // Scratch for the scan
+
+  void MoveBall();
+  void MoveBalls();
+  void TakeBall();
+  void KillBrick(int i);
+  void SweepBrick(int i, float cx, float cy, float r, float dx, float dy, Contact& contact) const;
+};
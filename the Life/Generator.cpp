@@ -0,0 +1,238 @@
+#include "Generator.h"
+
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+static uint64_t SplitMix64(uint64_t& state)
+{
+  uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+void Xoshiro256::Seed(uint64_t seed, uint64_t stream)
+{
+  uint64_t state = seed ^ SplitMix64(stream);
+  int k;
+
+  for (k = 0; k < 4; k++)
+    s[k] = SplitMix64(state);
+}
+
+// Row colors, top to bottom
+static const uint32_t palette[] = { 0xFF0000FF, 0xFF8000FF, 0xFFFF00FF, 0x00FF00FF, 0x00FFFFFF, 0xFF00FFFF };
+
+static const char* pattern_names[] = { "grid", "noise", "maze", "sizes" };
+
+LevelGenerator::LevelGenerator()
+{
+  pattern = GRID;
+  seed = 1;
+  columns = 20;
+  rows = 10;
+  cell_w = 32;
+  cell_h = 14;
+  brick_w = 30;
+  brick_h = 12;
+  threads = 0;
+}
+
+int LevelGenerator::Width() const
+{
+  return columns * cell_w + 20;
+}
+
+int LevelGenerator::Height() const
+{
+  return rows * cell_h + 420;
+}
+
+int LevelGenerator::PatternFromName(const char* name)
+{
+  int k;
+
+  for (k = 0; k < 4; k++)
+    if (strcmp(name, pattern_names[k]) == 0)
+      return k;
+
+  return -1;
+}
+
+const char* LevelGenerator::PatternName(int which)
+{
+  return which >= 0 && which < 4 ? pattern_names[which] : "?";
+}
+
+// Noise value at a lattice point, 0..1, hashed from the seed so any point
+// can be asked for in any order
+static float Lattice(uint64_t seed, int gx, int gy)
+{
+  uint64_t state = seed ^ ((uint64_t)(uint32_t)gx << 32 | (uint32_t)gy);
+
+  return (SplitMix64(state) >> 40) / 16777216.0f;
+}
+
+static float Smooth(float t)
+{
+  return t * t * (3 - 2 * t);
+}
+
+int LevelGenerator::Row(int row, int32_t* x, int32_t* y, int32_t* w, int32_t* h, uint32_t* color) const
+{
+  Xoshiro256 random(seed, (uint64_t)row);
+  uint32_t rgba = palette[row % 6];
+  int top = 10 + row * cell_h;
+  int n = 0, c, left, width;
+  float top_left = 0, top_right = 0, bottom_left = 0, bottom_right = 0, fy;
+
+  // One brick at left, width wide
+  auto emit = [&](int at, int wide)
+  {
+    if (x != NULL)
+    {
+      x[n] = 10 + at;
+      y[n] = top;
+      w[n] = wide;
+      h[n] = brick_h;
+      color[n] = rgba;
+    }
+    n++;
+  };
+
+  switch (pattern)
+  {
+  case GRID:
+    for (c = 0; c < columns; c++)
+      emit(c * cell_w, brick_w);
+    break;
+
+  case NOISE:
+    // Value noise: a lattice point every 8 cells, blended smoothly in
+    // between, and a brick wherever it is above 0.4
+    fy = Smooth((row & 7) / 8.0f);
+    for (c = 0; c < columns; c++)
+    {
+      if ((c & 7) == 0)
+      {
+        top_left = Lattice(seed, c >> 3, row >> 3);
+        top_right = Lattice(seed, (c >> 3) + 1, row >> 3);
+        bottom_left = Lattice(seed, c >> 3, (row >> 3) + 1);
+        bottom_right = Lattice(seed, (c >> 3) + 1, (row >> 3) + 1);
+      }
+
+      float fx = Smooth((c & 7) / 8.0f);
+      float top = top_left + (top_right - top_left) * fx;
+      float bottom = bottom_left + (bottom_right - bottom_left) * fx;
+
+      if (top + (bottom - top) * fy > 0.4f)
+        emit(c * cell_w, brick_w);
+    }
+    break;
+
+  case MAZE:
+  {
+    // Sidewinder: each maze row only decides its own east passages and
+    // which cell of each run opens to the row above, so rows don't
+    // depend on each other. Brick row 2r is the wall above maze row r,
+    // 2r + 1 the row itself; the bottom is left open for the ball
+    int cells = (columns - 1) / 2, r = row / 2, start = 0, i, k;
+    std::vector<char> east(cells, 0), north(cells, 0);
+
+    random.Seed(seed, (uint64_t)r);  // Both brick rows see the same maze row
+    if (r == 0)
+      std::fill(east.begin(), east.end(), 1);
+    else
+      for (i = 0; i < cells; i++)
+      {
+        if (i + 1 < cells && random.Below(2) == 0)
+          east[i] = 1;
+        else
+        {
+          k = start + (int)random.Below((uint32_t)(i - start + 1));
+          north[k] = 1;
+          start = i + 1;
+        }
+      }
+
+    for (c = 0; c <= 2 * cells && cells > 0; c++)
+      if (row % 2 == 0 ? c % 2 == 0 || r == 0 || !north[c / 2]
+                       : c == 0 || c == 2 * cells || (c % 2 == 0 && !east[c / 2 - 1]))
+        emit(c * cell_w, brick_w);
+    break;
+  }
+
+  case RANDOM_SIZES:
+    // Packed left to right, half a cell to three cells wide, the last one
+    // cut to fit. Generate keeps brick_w <= cell_w, so left always moves
+    for (left = 0; left < columns * cell_w; left += width + cell_w - brick_w)
+    {
+      width = std::max(1, cell_w / 2) + (int)random.Below((uint32_t)(cell_w * 5 / 2));
+      width = std::min(width, columns * cell_w - left);
+      emit(left, width);
+    }
+    break;
+  }
+
+  return n;
+}
+
+const char* LevelGenerator::Generate(BrickSoA& bricks) const
+{
+  int workers = threads > 0 ? threads : (int)std::max(1u, std::thread::hardware_concurrency());
+  std::vector<int> start(rows + 1, 0);
+  std::vector<std::thread> pool;
+  int32_t *x, *y, *w, *h;
+  uint32_t* color;
+  int r, k;
+
+  if (pattern < GRID || pattern > RANDOM_SIZES)
+    return "unknown pattern";
+  if (columns <= 0 || rows <= 0 || cell_w <= 0 || cell_h <= 0 || brick_w <= 0 || brick_h <= 0)
+    return "sizes have to be positive";
+  if (brick_w > cell_w || brick_h > cell_h)
+    return "bricks larger than their cells";
+  if ((int64_t)columns * cell_w + 20 > 0x7FFFFFFF || (int64_t)rows * cell_h + 420 > 0x7FFFFFFF)
+    return "level too large";
+
+  workers = std::max(1, std::min(workers, rows));
+
+  // Worker k takes a block of rows; with one worker it all runs here
+  auto parallel = [&](auto row)
+  {
+    auto block = [&](int part)
+    {
+      int first = (int)((int64_t)rows * part / workers), last = (int)((int64_t)rows * (part + 1) / workers);
+
+      for (int i = first; i < last; i++)
+        row(i);
+    };
+
+    for (k = 1; k < workers; k++)
+      pool.emplace_back(block, k);
+    block(0);
+    for (k = 0; k < (int)pool.size(); k++)
+      pool[k].join();
+    pool.clear();
+  };
+
+  // Count every row, then each row knows where its bricks start and
+  // fills them in place
+  parallel([&](int r) { start[r + 1] = Row(r, NULL, NULL, NULL, NULL, NULL); });
+
+  for (r = 0; r < rows; r++)
+    start[r + 1] += start[r];
+
+  bricks.Allocate(start[rows], x, y, w, h, color);
+
+  parallel([&](int r) { Row(r, x + start[r], y + start[r], w + start[r], h + start[r], color + start[r]); });
+
+  return NULL;
+}
+
+LevelGenerator::~LevelGenerator()
+{
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+// Levels built from a seed, for testing how things scale. Every row has
+// its own random stream derived from the seed and the row number, so
+// rows can be built on any number of threads in any order and the same
+// seed always gives the same level, on any machine.
+
+#include <stdint.h>
+
+#include "Bricks.h"
+
+// xoshiro256** with a splitmix64 seeding
+class Xoshiro256
+{
+public:
+  Xoshiro256(uint64_t seed = 0, uint64_t stream = 0)
+  {
+    Seed(seed, stream);
+  }
+
+  void Seed(uint64_t seed, uint64_t stream = 0);
+
+  uint64_t Next()
+  {
+    uint64_t result = Rotate(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = Rotate(s[3], 45);
+
+    return result;
+  }
+
+  // 0 .. n - 1
+  uint32_t Below(uint32_t n)
+  {
+    return (uint32_t)((Next() >> 32) * n >> 32);
+  }
+
+private:
+  uint64_t s[4];
+
+  static uint64_t Rotate(uint64_t x, int k)
+  {
+    return (x << k) | (x >> (64 - k));
+  }
+};
+
+class LevelGenerator
+{
+public:
+  enum Pattern
+  {
+    GRID,          // Every cell
+    NOISE,         // Every cell, with holes carved by smooth noise
+    MAZE,          // Maze walls, one brick per wall cell
+    RANDOM_SIZES   // Rows packed with bricks of random width
+  };
+
+  int pattern;
+  uint64_t seed;
+  int columns;       // Cells across and down
+  int rows;
+  int cell_w;        // Cell spacing and brick size inside it
+  int cell_h;
+  int brick_w;
+  int brick_h;
+  int threads;       // 0 for one per hardware thread
+
+  LevelGenerator();
+
+  // Replaces bricks with the level, written straight into their arrays.
+  // NULL on success, else what is wrong with the settings and bricks are
+  // left as they were
+  const char* Generate(BrickSoA& bricks) const;
+
+  // Play area with the level at the top and room for the paddle below
+  int Width() const;
+  int Height() const;
+
+  static int PatternFromName(const char* name);  // -1 when unknown
+  static const char* PatternName(int pattern);
+
+  ~LevelGenerator();
+
+private:
+  // Bricks of one row, written out when x is not NULL. Returns how many
+  int Row(int row, int32_t* x, int32_t* y, int32_t* w, int32_t* h, uint32_t* color) const;
+};
@@ -0,0 +1,154 @@
+#include "Grid.h"
+#include "Game.h"
+
+BrickGrid::BrickGrid()
+{
+  origin_x = 0;
+  origin_y = 0;
+  cell_w = 1;
+  cell_h = 1;
+  columns = 0;
+  rows = 0;
+  query = 0;
+}
+
+bool BrickGrid::Cells(float x0, float y0, float x1, float y1, int& c0, int& r0, int& c1, int& r1) const
+{
+  float fc0 = floorf((x0 - origin_x) / cell_w);
+  float fc1 = floorf((x1 - origin_x) / cell_w);
+  float fr0 = floorf((y0 - origin_y) / cell_h);
+  float fr1 = floorf((y1 - origin_y) / cell_h);
+
+  // Clamped before the conversion, a box far off the grid is no overflow
+  if (fc1 < 0 || fr1 < 0 || fc0 >= columns || fr0 >= rows)
+    return false;
+
+  c0 = fc0 > 0 ? (int)fc0 : 0;
+  r0 = fr0 > 0 ? (int)fr0 : 0;
+  c1 = fc1 < columns - 1 ? (int)fc1 : columns - 1;
+  r1 = fr1 < rows - 1 ? (int)fr1 : rows - 1;
+
+  return true;
+}
+
+void BrickGrid::Build(const BrickSoA& bricks)
+{
+  float x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+  double total_w = 0, total_h = 0;
+  int live = 0;
+  int c0, r0, c1, r1, c, r;
+  size_t cells, cell;
+
+  columns = 0;
+  rows = 0;
+  cell_start.clear();
+  cell_count.clear();
+  indices.clear();
+  stamp.assign(bricks.Count(), 0u);
+  query = 0;
+
+  // Bounds of the live bricks and their average size
+  bricks.ForEachAlive([&](int i)
+  {
+    if (live == 0 || bricks.pos_x[i] < x0)
+      x0 = (float)bricks.pos_x[i];
+    if (live == 0 || bricks.pos_y[i] < y0)
+      y0 = (float)bricks.pos_y[i];
+    if (live == 0 || bricks.pos_x[i] + bricks.weight[i] > x1)
+      x1 = (float)(bricks.pos_x[i] + bricks.weight[i]);
+    if (live == 0 || bricks.pos_y[i] + bricks.hight[i] > y1)
+      y1 = (float)(bricks.pos_y[i] + bricks.hight[i]);
+
+    total_w += bricks.weight[i];
+    total_h += bricks.hight[i];
+    live++;
+  });
+
+  if (live == 0)
+    return;
+
+  origin_x = x0;
+  origin_y = y0;
+  cell_w = std::max(1.0f, (float)(total_w / live));
+  cell_h = std::max(1.0f, (float)(total_h / live));
+
+  // A few bricks far apart would ask for a huge mostly empty grid, so
+  // cells grow until there are at most 4 per live brick
+  while (ceil((x1 - x0) / cell_w) * ceil((y1 - y0) / cell_h) > 4.0 * live)
+  {
+    cell_w *= 2;
+    cell_h *= 2;
+  }
+
+  columns = std::max(1, (int)ceilf((x1 - x0) / cell_w));
+  rows = std::max(1, (int)ceilf((y1 - y0) / cell_h));
+  cells = (size_t)columns * rows;
+
+  // Count, prefix sum, fill: one contiguous array for all cells
+  cell_start.assign(cells + 1, 0);
+  cell_count.assign(cells, 0);
+
+  bricks.ForEachAlive([&](int i)
+  {
+    if (BrickCells(bricks, i, c0, r0, c1, r1))
+      for (r = r0; r <= r1; r++)
+        for (c = c0; c <= c1; c++)
+          cell_count[(size_t)r * columns + c]++;
+  });
+
+  for (cell = 0; cell < cells; cell++)
+  {
+    cell_start[cell + 1] = cell_start[cell] + cell_count[cell];
+    cell_count[cell] = 0;
+  }
+
+  indices.resize(cell_start[cells]);
+
+  bricks.ForEachAlive([&](int i)
+  {
+    if (BrickCells(bricks, i, c0, r0, c1, r1))
+      for (r = r0; r <= r1; r++)
+        for (c = c0; c <= c1; c++)
+        {
+          cell = (size_t)r * columns + c;
+          indices[cell_start[cell] + cell_count[cell]++] = i;
+        }
+  });
+}
+
+bool BrickGrid::BrickCells(const BrickSoA& bricks, int i, int& c0, int& r0, int& c1, int& r1) const
+{
+  // A brick ending exactly on a cell edge is not in the next cell
+  return Cells((float)bricks.pos_x[i], (float)bricks.pos_y[i],
+               (float)(bricks.pos_x[i] + bricks.weight[i]) - 0.001f,
+               (float)(bricks.pos_y[i] + bricks.hight[i]) - 0.001f, c0, r0, c1, r1);
+}
+
+void BrickGrid::Remove(const BrickSoA& bricks, int index)
+{
+  int c0, r0, c1, r1, c, r;
+  size_t cell, k, end;
+
+  if (columns == 0 || !BrickCells(bricks, index, c0, r0, c1, r1))
+    return;
+
+  for (r = r0; r <= r1; r++)
+    for (c = c0; c <= c1; c++)
+    {
+      cell = (size_t)r * columns + c;
+      end = cell_start[cell] + cell_count[cell];
+
+      for (k = cell_start[cell]; k < end; k++)
+        if (indices[k] == index)
+        {
+          indices[k] = indices[end - 1];
+          indices[end - 1] = index;
+          cell_count[cell]--;
+          break;
+        }
+    }
+}
+
+BrickGrid::~BrickGrid()
+{
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+// Uniform grid over the bricks, so the ball only looks at the bricks
+// near its path. Cells are the size of an average brick, grown when that
+// would make more than 4 cells per brick; a brick is listed in every cell
+// it overlaps. Each cell keeps its live bricks at the front of its range,
+// so removing one is a swap inside the cell.
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+class BrickSoA;
+
+class BrickGrid
+{
+public:
+  BrickGrid();
+
+  void Build(const BrickSoA& bricks);
+
+  void Remove(const BrickSoA& bricks, int index);  // After bricks.Kill(index)
+
+  // Calls visit(index) once for every live brick listed in the cells the
+  // box [x0, x1] x [y0, y1] overlaps
+  template <class F>
+  void Query(float x0, float y0, float x1, float y1, F visit)
+  {
+    int c0, c1, r0, r1, c, r, index;
+    size_t cell, k, end;
+
+    if (columns == 0 || !Cells(x0, y0, x1, y1, c0, r0, c1, r1))
+      return;
+
+    if (++query == 0) // Stamps wrapped around, start over
+    {
+      std::fill(stamp.begin(), stamp.end(), 0u);
+      query = 1;
+    }
+
+    for (r = r0; r <= r1; r++)
+      for (c = c0; c <= c1; c++)
+      {
+        cell = (size_t)r * columns + c;
+        end = cell_start[cell] + cell_count[cell];
+        for (k = cell_start[cell]; k < end; k++)
+        {
+          index = indices[k];
+          if (stamp[index] != query)
+          {
+            stamp[index] = query;
+            visit(index);
+          }
+        }
+      }
+  }
+
+  // False when the box is clear of the area the bricks were in at Build
+  bool Near(float x0, float y0, float x1, float y1) const
+  {
+    return columns > 0 && x1 >= origin_x && y1 >= origin_y &&
+           x0 <= origin_x + columns * cell_w && y0 <= origin_y + rows * cell_h;
+  }
+
+  ~BrickGrid();
+
+private:
+  float origin_x;
+  float origin_y;
+  float cell_w;
+  float cell_h;
+  int columns;
+  int rows;
+
+  std::vector<size_t> cell_start;  // Cell c is indices[cell_start[c] ..]
+  std::vector<int> cell_count;     // Live bricks at the front of cell c
+  std::vector<int> indices;
+  std::vector<unsigned> stamp;     // Per brick, last query that visited it
+  unsigned query;
+
+  // Cell range overlapped by a box, false when it misses the grid
+  bool Cells(float x0, float y0, float x1, float y1, int& c0, int& r0, int& c1, int& r1) const;
+  bool BrickCells(const BrickSoA& bricks, int i, int& c0, int& r0, int& c1, int& r1) const;
+};
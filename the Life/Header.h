@@ -3,7 +3,65 @@
 #include <iostream>
 #include <SDL.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <vector>
+
+#include "Game.h"
+#include "Particles.h"
+#include "Timing.h"
+
+// CPU time used by the whole process so far, in seconds
+double ProcessCpuSeconds();
+
+// Sleep until a SDL_GetPerformanceCounter deadline, whole milliseconds
+// with SDL_Delay and only the last fraction of one by yielding
+void SleepUntil(Uint64 deadline);
+
+// A level file mapped in place, or read with SDL_RWFromFile where it
+// can't be mapped. NULL when it can't be opened at all
+std::shared_ptr<LevelFile> OpenLevel(const char* path);
+
+// Triangles for the whole frame, grouped by texture (NULL for solid color).
+// Flush sends each group with one SDL_RenderGeometry, in first-use order
+class GeometryBatch
+{
+public:
+  int draw_calls;  // Submissions made by the last Flush
+
+  GeometryBatch();
+
+  void AddRect(const SDL_Rect& rect, SDL_Color color)
+  {
+    AddQuad(NULL, rect, color);
+  }
+
+  void AddRects(const SDL_Rect* rects, int count, SDL_Color color)
+  {
+    int i;
+
+    for (i = 0; i < count; i++)
+      AddQuad(NULL, rects[i], color);
+  }
+
+  void AddQuad(SDL_Texture* texture, const SDL_Rect& rect, SDL_Color color);
+
+  void Flush(SDL_Renderer* renderer);
+
+  ~GeometryBatch();
+
+private:
+  struct Group
+  {
+    SDL_Texture* texture;
+    std::vector<SDL_Vertex> vertices;
+    std::vector<int> indices;
+  };
+
+  std::vector<Group> groups;  // Kept between frames so the arrays are reused
+  std::vector<int> order;     // Groups touched this frame, in first-use order
+};
 
 class Circle 
 {
@@ -12,25 +70,58 @@ public:
   int pos_y;
   int speed_x;
   int speed_y;
+  int radius;
+  SDL_Color color;
 
   Circle();
 
   void Draw(SDL_Renderer* renderer)
   {
-    int i, j, k;
+    SDL_Rect rect;
+
+    // The disk is rasterized once and rebuilt only when it changes
+    if (texture == NULL || texture_renderer != renderer || texture_radius != radius ||
+        texture_color.r != color.r || texture_color.g != color.g ||
+        texture_color.b != color.b || texture_color.a != color.a)
+      Rasterize(renderer);
+
+    rect.x = pos_x;
+    rect.y = pos_y;
+    rect.w = 2 * radius;
+    rect.h = 2 * radius;
+
+    SDL_RenderCopy(renderer, texture, NULL, &rect);
+  }
+
+  void Draw(SDL_Renderer* renderer, GeometryBatch& batch)
+  {
+    SDL_Rect rect;
+    SDL_Color white = { 255, 255, 255, 255 };
+
+    if (texture == NULL || texture_renderer != renderer || texture_radius != radius ||
+        texture_color.r != color.r || texture_color.g != color.g ||
+        texture_color.b != color.b || texture_color.a != color.a)
+      Rasterize(renderer);
 
-    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    rect.x = pos_x;
+    rect.y = pos_y;
+    rect.w = 2 * radius;
+    rect.h = 2 * radius;
 
-    for (i = -10; i < 10; i++)
-      for (j = -10; j < 10; j++)
-        if (i * i + j * j <= 100)
-          SDL_RenderDrawPoint(renderer, pos_x + 10 + i, pos_y + 10 + j);
+    batch.AddQuad(texture, rect, white); // Textured quad, the color is in the texture
   }
 
+  void Release(); // Free the texture while the renderer is still alive
+
   ~Circle();
 
 private:
+  SDL_Texture* texture;
+  SDL_Renderer* texture_renderer;
+  int texture_radius;
+  SDL_Color texture_color;
 
+  void Rasterize(SDL_Renderer* renderer);
 };
 
 class Platform
@@ -57,39 +148,171 @@ public:
     SDL_RenderFillRect(renderer, &rect);
   }
 
+  void Draw(GeometryBatch& batch, SDL_Color color)
+  {
+    SDL_Rect rect;
+    rect.x = pos_x;
+    rect.y = pos_y;
+    rect.w = weight;
+    rect.h = hight;
+
+    batch.AddRect(rect, color);
+  }
+
   ~Platform();
 
 private:
  
 };
 
-class Brick
+// Live bricks grouped by color into contiguous rect arrays,
+// each group goes out with one SDL_RenderFillRects
+class BrickBatch
 {
 public:
-  Brick();
-  
-  int pos_x;
-  int pos_y;
-  int hight;
-  int weight;
+  bool dirty;  // Set when a brick is destroyed
 
-  bool print;  // Draw the brick or no
+  BrickBatch();
 
-  void Draw(SDL_Window* window, SDL_Renderer* renderer,
-            int color1, int color2, int color3, int color4)
+  void Rebuild(const BrickSoA& bricks);
+
+  void Draw(SDL_Renderer* renderer)
   {
-    SDL_Rect rect;
-    rect.x = pos_x;
-    rect.y = pos_y;
-    rect.w = weight;
-    rect.h = hight;
+    size_t g;
 
-    SDL_SetRenderDrawColor(renderer, color1, color2, color3, color4);
-    SDL_RenderFillRect(renderer, &rect);
+    for (g = 0; g < colors.size(); g++)
+    {
+      SDL_SetRenderDrawColor(renderer, colors[g].r, colors[g].g, colors[g].b, colors[g].a);
+      SDL_RenderFillRects(renderer, &rects[starts[g]], starts[g + 1] - starts[g]);
+    }
+  }
+
+  void Draw(GeometryBatch& batch)
+  {
+    size_t g;
+
+    for (g = 0; g < colors.size(); g++)
+      batch.AddRects(&rects[starts[g]], starts[g + 1] - starts[g], colors[g]);
+  }
+
+  ~BrickBatch();
+
+private:
+  std::vector<SDL_Color> colors;   // One color per group
+  std::vector<int> starts;         // Group g is rects[starts[g] .. starts[g + 1])
+  std::vector<SDL_Rect> rects;
+  std::vector<Uint64> keys;        // Scratch: color << 32 | brick index
+};
+
+// The brick field drawn once into a target texture and copied to the
+// screen in one call, so a frame costs the same however many bricks
+// there are. Destroyed bricks are painted over with the background; the
+// whole layer is redrawn only when it is new, the output size changed,
+// bricks came back (another level or a restart) or the renderer lost it.
+// Bricks are assumed not to overlap, a hole would cut into a neighbour
+class BrickLayer
+{
+public:
+  bool lost;     // Set on SDL_RENDER_TARGETS_RESET, the texture needs redrawing
+  bool redrawn;  // The last Update drew the whole layer again
+
+  BrickLayer();
+
+  // Brings the texture up to bricks. False when the renderer has no
+  // target textures, the bricks have to be drawn some other way
+  bool Update(SDL_Renderer* renderer, const BrickSoA& bricks, int version);
+
+  void Draw(SDL_Renderer* renderer)
+  {
+    SDL_RenderCopy(renderer, texture, NULL, NULL);
+  }
+
+  // Only rect of the layer, to the same place on the screen
+  void Draw(SDL_Renderer* renderer, const SDL_Rect& rect)
+  {
+    SDL_RenderCopy(renderer, texture, &rect, &rect);
+  }
+
+  // Bricks the last Update painted over
+  const std::vector<SDL_Rect>& Holes() const
+  {
+    return holes;
   }
 
-  ~Brick();
+  void Release(); // Free the texture while the renderer is still alive
+
+  ~BrickLayer();
 
 private:
+  SDL_Texture* texture;
+  SDL_Renderer* texture_renderer;
+  int texture_w;
+  int texture_h;
+  int texture_version;             // Version of the bricks drawn
+  std::vector<uint64_t> drawn;     // Live bits of the bricks drawn
+  std::vector<SDL_Rect> holes;     // Scratch: bricks gone since the last Update
+  BrickBatch batch;
+  GeometryBatch geometry;
+
+  void Redraw(SDL_Renderer* renderer, const BrickSoA& bricks, int version, int width, int height);
+};
+
+// Screen areas that changed this frame, for presenting only those. Rects
+// that touch are merged, and past MAX_RECTS a new rect is merged into the
+// one it grows least, so the list stays short and never overlaps
+class DirtyRects
+{
+public:
+  enum { MAX_RECTS = 32 };
+
+  DirtyRects();
+
+  void SetBounds(int width, int height);  // Rects are clipped to these
+
+  void Add(const SDL_Rect& rect);
+
+  void AddAll()
+  {
+    SDL_Rect all = { 0, 0, width, height };
+
+    rects.clear();
+    rects.push_back(all);
+  }
+
+  void Clear()
+  {
+    rects.clear();
+  }
+
+  int Count() const
+  {
+    return (int)rects.size();
+  }
+
+  const SDL_Rect* Rects() const
+  {
+    return rects.empty() ? NULL : &rects[0];
+  }
+
+  long long Pixels() const;  // Covered by the rects
 
+  ~DirtyRects();
+
+private:
+  std::vector<SDL_Rect> rects;
+  int width;
+  int height;
 };
+
+// Box around every particle, empty when there are none
+SDL_Rect ParticleBounds(const ParticlePool& particles);
+
+// Every particle as a small solid quad, fading to the black background as
+// it ages. All of them land in the solid color group, so no draw call of
+// their own
+void DrawParticles(const ParticlePool& particles, GeometryBatch& batch);
+
+// The last second of every phase as a row of bars at the top left: max,
+// p99, p95 and p50 over each other, and a white line at budget, which is
+// a quarter of the way across. Returns the area it covers
+SDL_Rect DrawTiming(const FrameTimer& timer, Uint64 budget_ns, GeometryBatch& batch);
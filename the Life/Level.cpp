@@ -0,0 +1,388 @@
+// fopen and sscanf are fine here, SDL checks would make them errors
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include "Level.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char LEVEL_MAGIC[4] = { 'A', 'R', 'K', 'L' };
+static const char UNCHECKED[] = "not checked yet";  // verdict before Check(true)
+
+static size_t Padded(size_t count)
+{
+  return (count + 7) & ~(size_t)7;
+}
+
+LevelFile::LevelFile()
+{
+  data = NULL;
+  size = 0;
+  mapping = NULL;
+  verdict.store(UNCHECKED);
+#ifdef _WIN32
+  file_handle = INVALID_HANDLE_VALUE;
+  mapping_handle = NULL;
+#endif
+}
+
+void LevelFile::Close()
+{
+#ifdef _WIN32
+  if (mapping != NULL)
+    UnmapViewOfFile(mapping);
+  if (mapping_handle != NULL)
+    CloseHandle(mapping_handle);
+  if (file_handle != INVALID_HANDLE_VALUE)
+    CloseHandle(file_handle);
+  file_handle = INVALID_HANDLE_VALUE;
+  mapping_handle = NULL;
+#else
+  if (mapping != NULL)
+    munmap(mapping, size);
+#endif
+  mapping = NULL;
+  buffer.clear();
+  data = NULL;
+  size = 0;
+  verdict.store(UNCHECKED);
+}
+
+bool LevelFile::Map(const char* path)
+{
+  Close();
+
+#ifdef _WIN32
+  LARGE_INTEGER length;
+
+  file_handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file_handle == INVALID_HANDLE_VALUE)
+    return false;
+
+  if (!GetFileSizeEx(file_handle, &length) || length.QuadPart == 0 ||
+      (mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL)) == NULL ||
+      (mapping = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0)) == NULL)
+  {
+    Close();
+    return false;
+  }
+
+  size = (size_t)length.QuadPart;
+#else
+  struct stat info;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0)
+    return false;
+
+  if (fstat(fd, &info) != 0 || info.st_size == 0)
+  {
+    close(fd);
+    return false;
+  }
+
+  mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);  // The mapping keeps the file open
+
+  if (mapping == MAP_FAILED)
+  {
+    mapping = NULL;
+    return false;
+  }
+
+  size = (size_t)info.st_size;
+#endif
+
+  data = (const uint8_t*)mapping;
+  return true;
+}
+
+bool LevelFile::Read(const char* path)
+{
+  FILE* file;
+  long length;
+  uint8_t* bytes;
+  bool ok;
+
+  Close();
+
+  file = fopen(path, "rb");
+  if (file == NULL)
+    return false;
+
+  ok = fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) > 0 && fseek(file, 0, SEEK_SET) == 0;
+  if (ok)
+  {
+    bytes = Allocate((size_t)length);
+    ok = fread(bytes, 1, (size_t)length, file) == (size_t)length;
+  }
+  fclose(file);
+
+  if (!ok)
+    Close();
+
+  return ok;
+}
+
+uint8_t* LevelFile::Allocate(size_t bytes)
+{
+  Close();
+
+  // 64-bit words, so the arrays in it are at least 8-byte aligned
+  buffer.resize((bytes + 7) / 8);
+  data = (const uint8_t*)buffer.data();
+  size = bytes;
+
+  return (uint8_t*)buffer.data();
+}
+
+const char* LevelFile::Check(bool checksum) const
+{
+  const int32_t *pos_x, *pos_y, *weight, *hight;
+  const char* error;
+  size_t padded, i;
+
+  if (data == NULL || size < sizeof(LevelHeader))
+    return "too short for a level header";
+
+  const LevelHeader& header = Header();
+
+  if (memcmp(header.magic, LEVEL_MAGIC, 4) != 0)
+    return "not a level file";
+  if (header.version != LEVEL_VERSION)
+    return "level file version not supported";
+  if (header.count > 0x7FFFFFF8u || sizeof(LevelHeader) + 5 * 4 * Padded(header.count) != size)
+    return "brick count does not match the file size";
+  if (header.width > 0x7FFFFFFFu || header.height > 0x7FFFFFFFu)
+    return "play area too large";
+
+  // Every byte is read once per file, after that the answer is kept
+  error = verdict.load(std::memory_order_acquire);
+  if (error != UNCHECKED || !checksum)
+    return error != UNCHECKED ? error : NULL;
+
+  // The grid and the collision code take every brick to have an area and
+  // to lie inside the play area, which also keeps x + width in an int32_t
+  padded = Padded(header.count);
+  pos_x = (const int32_t*)(data + sizeof(LevelHeader));
+  pos_y = pos_x + padded;
+  weight = pos_y + padded;
+  hight = weight + padded;
+  error = NULL;
+  for (i = 0; i < header.count && error == NULL; i++)
+  {
+    if (weight[i] <= 0 || hight[i] <= 0)
+      error = "brick with no width or height";
+    else if (pos_x[i] < 0 || pos_y[i] < 0 || (int64_t)pos_x[i] + weight[i] > header.width ||
+             (int64_t)pos_y[i] + hight[i] > header.height)
+      error = "brick outside the play area";
+  }
+
+  if (error == NULL && LevelChecksum(data + sizeof(LevelHeader), size - sizeof(LevelHeader)) != header.checksum)
+    error = "checksum mismatch";
+
+  verdict.store(error, std::memory_order_release);
+  return error;
+}
+
+LevelFile::~LevelFile()
+{
+  Close();
+}
+
+// FNV-1a on 64-bit words, four words at a time in separate lanes so the
+// multiplies overlap. size is a multiple of 32, as the arrays are
+uint32_t LevelChecksum(const uint8_t* data, size_t size)
+{
+  const uint64_t prime = 0x100000001B3ull;
+  uint64_t lane[4] = { 0xCBF29CE484222325ull, 0x84222325CBF29CE4ull, 0xCE484222325CBF29ull, 0x2325CBF29CE48422ull };
+  uint64_t word[4], hash;
+  size_t i;
+  int k;
+
+  for (i = 0; i + 32 <= size; i += 32)
+  {
+    memcpy(word, data + i, 32);
+    for (k = 0; k < 4; k++)
+      lane[k] = (lane[k] ^ word[k]) * prime;
+  }
+
+  hash = lane[0];
+  for (k = 1; k < 4; k++)
+    hash = (hash ^ lane[k]) * prime;
+
+  return (uint32_t)(hash ^ hash >> 32);
+}
+
+void UseLevel(const std::shared_ptr<const LevelFile>& file, BrickSoA& bricks)
+{
+  const LevelHeader& header = file->Header();
+  size_t padded = Padded(header.count);
+  const int32_t* arrays = (const int32_t*)(file->data + sizeof(LevelHeader));
+
+  bricks.Borrow(file, (int)header.count, arrays, arrays + padded, arrays + 2 * padded,
+                arrays + 3 * padded, (const uint32_t*)(arrays + 4 * padded));
+}
+
+const char* WriteLevel(const char* path, const BrickSoA& bricks, int width, int height)
+{
+  LevelHeader header;
+  std::vector<uint32_t> body;
+  size_t padded = Padded(bricks.Count());
+  const void* arrays[5] = { bricks.pos_x, bricks.pos_y, bricks.weight, bricks.hight, bricks.color };
+  FILE* file;
+  bool ok;
+  int k;
+
+  // All five arrays back to back, zero padded
+  body.assign(5 * padded, 0);
+  for (k = 0; k < 5 && bricks.Count() > 0; k++)
+    memcpy(&body[k * padded], arrays[k], bricks.Count() * sizeof(uint32_t));
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, LEVEL_MAGIC, 4);
+  header.version = LEVEL_VERSION;
+  header.count = (uint32_t)bricks.Count();
+  header.width = (uint32_t)width;
+  header.height = (uint32_t)height;
+  header.checksum = LevelChecksum((const uint8_t*)body.data(), body.size() * sizeof(uint32_t));
+
+  file = fopen(path, "wb");
+  if (file == NULL)
+    return "cannot create the level file";
+
+  ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+       fwrite(body.data(), sizeof(uint32_t), body.size(), file) == body.size();
+  ok = fclose(file) == 0 && ok;
+
+  return ok ? NULL : "cannot write the level file";
+}
+
+const char* ConvertLevel(const char* text_path, const char* level_path, char* error, size_t error_size)
+{
+  char line[1024], name[16], text[1000];
+  uint32_t colors[256];
+  std::vector<int> lines;  // Where each brick came from, for the errors
+  BrickSoA bricks;
+  FILE* file;
+  int width = 640, height = 480;
+  int origin_x = 10, origin_y = 10, cell_w = 32, cell_h = 14, size_w = 30, size_h = 12;
+  int row = 0, number = 0, x, y, w, h, i;
+  int64_t left, top;
+  unsigned rgba;
+  char symbol;
+
+  memset(colors, 0, sizeof(colors));
+  colors['#'] = 0xFF00FFFF;
+
+  file = fopen(text_path, "r");
+  if (file == NULL)
+    return "cannot open the text level";
+
+  while (fgets(line, sizeof(line), file) != NULL)
+  {
+    number++;
+
+    if (sscanf(line, "%15s", name) != 1 || name[0] == '#')
+      continue;
+
+    if (strcmp(name, "field") == 0 && sscanf(line, "%*s %d %d", &width, &height) == 2)
+    {
+      if (width > 0 && height > 0)
+        continue;
+      fclose(file);
+      snprintf(error, error_size, "line %d: field with no width or height", number);
+      return error;
+    }
+    if (strcmp(name, "brick") == 0 && sscanf(line, "%*s %d %d %d %d %x", &x, &y, &w, &h, &rgba) == 5)
+    {
+      bricks.Add(x, y, w, h, rgba);
+      lines.push_back(number);
+      continue;
+    }
+    if (strcmp(name, "origin") == 0 && sscanf(line, "%*s %d %d", &origin_x, &origin_y) == 2)
+    {
+      row = 0;
+      continue;
+    }
+    if (strcmp(name, "cell") == 0 && sscanf(line, "%*s %d %d", &cell_w, &cell_h) == 2)
+      continue;
+    if (strcmp(name, "size") == 0 && sscanf(line, "%*s %d %d", &size_w, &size_h) == 2)
+      continue;
+    if (strcmp(name, "color") == 0 && sscanf(line, "%*s %c %x", &symbol, &rgba) == 2)
+    {
+      colors[(unsigned char)symbol] = rgba;
+      continue;
+    }
+    if (strcmp(name, "row") == 0)
+    {
+      text[0] = 0;
+      sscanf(line, "%*s %999[^\r\n]", text);
+
+      for (i = 0; text[i] != 0; i++)
+        if (text[i] != '.' && text[i] != ' ')
+        {
+          if (colors[(unsigned char)text[i]] == 0)
+          {
+            fclose(file);
+            snprintf(error, error_size, "line %d: no color for '%c'", number, text[i]);
+            return error;
+          }
+
+          // Far enough out to overflow is outside any field
+          left = origin_x + (int64_t)i * cell_w;
+          top = origin_y + (int64_t)row * cell_h;
+          if (left < 0 || top < 0 || left > 0x7FFFFFFF || top > 0x7FFFFFFF)
+          {
+            fclose(file);
+            snprintf(error, error_size, "line %d: brick outside the field", number);
+            return error;
+          }
+
+          bricks.Add((int)left, (int)top, size_w, size_h, colors[(unsigned char)text[i]]);
+          lines.push_back(number);
+        }
+      row++;
+      continue;
+    }
+
+    fclose(file);
+    snprintf(error, error_size, "line %d: cannot read '%s'", number, name);
+    return error;
+  }
+
+  fclose(file);
+
+  // After the whole file, a field line may come after the bricks
+  for (i = 0; i < bricks.Count(); i++)
+  {
+    if (bricks.weight[i] <= 0 || bricks.hight[i] <= 0)
+    {
+      snprintf(error, error_size, "line %d: brick with no width or height", lines[i]);
+      return error;
+    }
+    if (bricks.pos_x[i] < 0 || bricks.pos_y[i] < 0 || (int64_t)bricks.pos_x[i] + bricks.weight[i] > width ||
+        (int64_t)bricks.pos_y[i] + bricks.hight[i] > height)
+    {
+      snprintf(error, error_size, "line %d: brick outside the field", lines[i]);
+      return error;
+    }
+  }
+
+  return WriteLevel(level_path, bricks, width, height);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+// Binary level files. The file is the bricks' arrays exactly as BrickSoA
+// keeps them, so loading is mapping the file and pointing at it:
+//
+//   LevelHeader                      32 bytes
+//   int32_t  pos_x[padded count]     padded count = count rounded up to 8,
+//   int32_t  pos_y[padded count]     so every array starts 32-byte aligned
+//   int32_t  weight[padded count]
+//   int32_t  hight[padded count]
+//   uint32_t color[padded count]     0xRRGGBBAA
+//
+// Little endian, the padding is zero. The checksum covers everything
+// after the header.
+//
+// Text levels (Headless --convert) are one directive per line, lines
+// starting with # are comments:
+//
+//   field 640 480                    play area, default 640 x 480
+//   brick 10 10 150 70 FF00FFFF      one brick: x y width height color
+//   origin 10 100                    top left of the first row
+//   cell 32 14                       row spacing, default 32 x 14
+//   size 30 12                       brick size in rows, default 30 x 12
+//   color R FF0000FF                 what a character in a row means
+//   row RR.RR                        a row of bricks, . or space is empty,
+//                                    # is magenta unless set otherwise
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "Bricks.h"
+
+struct LevelHeader
+{
+  char magic[4];        // "ARKL"
+  uint32_t version;     // LEVEL_VERSION
+  uint32_t count;       // Bricks
+  uint32_t width;       // Play area
+  uint32_t height;
+  uint32_t checksum;
+  uint32_t reserved[2];
+};
+
+enum
+{
+  LEVEL_VERSION = 1
+};
+
+// The bytes of a level file, mapped or read into memory
+class LevelFile
+{
+public:
+  const uint8_t* data;
+  size_t size;
+
+  LevelFile();
+
+  bool Map(const char* path);   // mmap, MapViewOfFile on Windows
+  bool Read(const char* path);  // stdio, for when mapping is not there
+
+  // Room for size bytes for a reader of its own to fill
+  uint8_t* Allocate(size_t bytes);
+
+  const LevelHeader& Header() const
+  {
+    return *(const LevelHeader*)data;
+  }
+
+  // NULL when the file is a level this build can use, else what is wrong.
+  // Check(true) reads every byte once: the checksum, and that every brick
+  // has an area and lies inside the play area. Its answer is kept, so any
+  // later Check is the header only. Check(false) on a file never checked
+  // in full trusts the bricks
+  const char* Check(bool checksum) const;
+
+  ~LevelFile();
+
+private:
+  void Close();
+
+  std::vector<uint64_t> buffer;  // Read() and Allocate() land here
+  void* mapping;
+  mutable std::atomic<const char*> verdict;  // What Check(true) found
+#ifdef _WIN32
+  void* file_handle;
+  void* mapping_handle;
+#endif
+
+  LevelFile(const LevelFile&);
+  LevelFile& operator=(const LevelFile&);
+};
+
+uint32_t LevelChecksum(const uint8_t* data, size_t size);
+
+// Points bricks at a file that passed Check(), every brick alive
+void UseLevel(const std::shared_ptr<const LevelFile>& file, BrickSoA& bricks);
+
+// NULL on success, else what went wrong
+const char* WriteLevel(const char* path, const BrickSoA& bricks, int width, int height);
+
+// NULL on success, else what went wrong. Errors about a line of the text
+// are written into error, and error is what comes back
+const char* ConvertLevel(const char* text_path, const char* level_path, char* error, size_t error_size);
@@ -0,0 +1,226 @@
+#include "Particles.h"
+
+#include "Bits.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define PARTICLES_X86
+#include <immintrin.h>
+#endif
+
+// Each kernel moves the particles in slots [first, last) and ages them
+static void UpdateScalar(ParticlePool& particles, int first, int last, float seconds)
+{
+  float* pos_x = particles.pos_x.data();
+  float* pos_y = particles.pos_y.data();
+  float* speed_x = particles.speed_x.data();
+  float* speed_y = particles.speed_y.data();
+  float* age = particles.age.data();
+  float fall = particles.gravity * seconds;
+  int i;
+
+  for (i = first; i < last; i++)
+  {
+    pos_x[i] += speed_x[i] * seconds;
+    pos_y[i] += speed_y[i] * seconds;
+    speed_y[i] += fall;
+    age[i] += seconds;
+  }
+}
+
+#ifdef PARTICLES_X86
+
+TARGET_SSE2
+static void UpdateSSE2(ParticlePool& particles, int first, int last, float seconds)
+{
+  float* pos_x = particles.pos_x.data();
+  float* pos_y = particles.pos_y.data();
+  float* speed_x = particles.speed_x.data();
+  float* speed_y = particles.speed_y.data();
+  float* age = particles.age.data();
+  const __m128 dt = _mm_set1_ps(seconds);
+  const __m128 fall = _mm_set1_ps(particles.gravity * seconds);
+  __m128 vy;
+  int i = first;
+
+  // Four particles per step
+  for (; i + 4 <= last; i += 4)
+  {
+    vy = _mm_loadu_ps(speed_y + i);
+    _mm_storeu_ps(pos_x + i, _mm_add_ps(_mm_loadu_ps(pos_x + i), _mm_mul_ps(_mm_loadu_ps(speed_x + i), dt)));
+    _mm_storeu_ps(pos_y + i, _mm_add_ps(_mm_loadu_ps(pos_y + i), _mm_mul_ps(vy, dt)));
+    _mm_storeu_ps(speed_y + i, _mm_add_ps(vy, fall));
+    _mm_storeu_ps(age + i, _mm_add_ps(_mm_loadu_ps(age + i), dt));
+  }
+
+  UpdateScalar(particles, i, last, seconds);
+}
+
+TARGET_AVX2
+static void UpdateAVX2(ParticlePool& particles, int first, int last, float seconds)
+{
+  float* pos_x = particles.pos_x.data();
+  float* pos_y = particles.pos_y.data();
+  float* speed_x = particles.speed_x.data();
+  float* speed_y = particles.speed_y.data();
+  float* age = particles.age.data();
+  const __m256 dt = _mm256_set1_ps(seconds);
+  const __m256 fall = _mm256_set1_ps(particles.gravity * seconds);
+  __m256 vy;
+  int i = first;
+
+  // Eight particles per step
+  for (; i + 8 <= last; i += 8)
+  {
+    vy = _mm256_loadu_ps(speed_y + i);
+    _mm256_storeu_ps(pos_x + i, _mm256_add_ps(_mm256_loadu_ps(pos_x + i), _mm256_mul_ps(_mm256_loadu_ps(speed_x + i), dt)));
+    _mm256_storeu_ps(pos_y + i, _mm256_add_ps(_mm256_loadu_ps(pos_y + i), _mm256_mul_ps(vy, dt)));
+    _mm256_storeu_ps(speed_y + i, _mm256_add_ps(vy, fall));
+    _mm256_storeu_ps(age + i, _mm256_add_ps(_mm256_loadu_ps(age + i), dt));
+  }
+
+  _mm256_zeroupper();
+
+  UpdateScalar(particles, i, last, seconds);
+}
+
+#endif
+
+static void UpdateSlots(ParticlePool& particles, int first, int last, float seconds)
+{
+#ifdef PARTICLES_X86
+  if (BrickSoA::SelectedKernel() == BrickSoA::AVX2)
+    UpdateAVX2(particles, first, last, seconds);
+  else if (BrickSoA::SelectedKernel() == BrickSoA::SSE2)
+    UpdateSSE2(particles, first, last, seconds);
+  else
+#endif
+    UpdateScalar(particles, first, last, seconds);
+}
+
+ParticlePool::ParticlePool()
+  : random(0x5EED)
+{
+  lifetime = 0.6f;
+  gravity = 600;
+  per_brick = 16;
+  frame_budget = 2048;
+  emitted = 0;
+  dropped = 0;
+  capacity = 0;
+  count = 0;
+  head = 0;
+}
+
+void ParticlePool::Reserve(int n)
+{
+  capacity = n;
+  count = 0;
+  head = 0;
+  pos_x.assign(n, 0.0f);
+  pos_y.assign(n, 0.0f);
+  speed_x.assign(n, 0.0f);
+  speed_y.assign(n, 0.0f);
+  age.assign(n, 0.0f);
+  color.assign(n, 0);
+}
+
+void ParticlePool::BeginFrame()
+{
+  emitted = 0;
+  dropped = 0;
+}
+
+bool ParticlePool::Emit(float x, float y, float vx, float vy, uint32_t rgba)
+{
+  if (emitted >= frame_budget || capacity == 0)
+  {
+    dropped++;
+    return false;
+  }
+
+  // A full ring writes over its oldest
+  pos_x[head] = x;
+  pos_y[head] = y;
+  speed_x[head] = vx;
+  speed_y[head] = vy;
+  age[head] = 0;
+  color[head] = rgba;
+
+  if (++head == capacity)
+    head = 0;
+  if (count < capacity)
+    count++;
+  emitted++;
+
+  return true;
+}
+
+void ParticlePool::EmitBrick(const BrickSoA& bricks, int i)
+{
+  float cx = bricks.pos_x[i] + bricks.weight[i] * 0.5f;
+  float cy = bricks.pos_y[i] + bricks.hight[i] * 0.5f;
+  float x, y, speed;
+  int k;
+
+  // From anywhere on the brick, away from its middle and a little up
+  for (k = 0; k < per_brick; k++)
+  {
+    // Over the budget the rest are only counted
+    if (emitted >= frame_budget)
+    {
+      dropped += per_brick - k;
+      return;
+    }
+
+    x = bricks.pos_x[i] + (float)random.Below((uint32_t)bricks.weight[i] + 1);
+    y = bricks.pos_y[i] + (float)random.Below((uint32_t)bricks.hight[i] + 1);
+    speed = 2.0f + random.Below(6);
+
+    Emit(x, y, (x - cx) * speed, (y - cy) * speed - 80.0f - random.Below(120), bricks.color[i]);
+  }
+}
+
+int ParticlePool::EmitDeaths(const BrickSoA& bricks, std::vector<uint64_t>& seen)
+{
+  uint64_t died;
+  size_t w;
+  int n = 0;
+
+  // Another level, nothing to compare with
+  if (seen.size() != bricks.live.size())
+  {
+    seen = bricks.live;
+    return 0;
+  }
+
+  for (w = 0; w < seen.size(); w++)
+  {
+    for (died = seen[w] & ~bricks.live[w]; died != 0; died &= died - 1, n++)
+      EmitBrick(bricks, (int)(w * 64 + CountTrailingZeros64(died)));
+    seen[w] = bricks.live[w];
+  }
+
+  return n;
+}
+
+void ParticlePool::Update(float seconds)
+{
+  int first = Oldest();
+
+  // The live slots are one run of the ring, or two when it wraps
+  if (first + count <= capacity)
+    UpdateSlots(*this, first, first + count, seconds);
+  else
+  {
+    UpdateSlots(*this, first, capacity, seconds);
+    UpdateSlots(*this, 0, head, seconds);
+  }
+
+  // Oldest first, so the expired ones are all at the tail
+  while (count > 0 && age[Oldest()] >= lifetime)
+    count--;
+}
+
+ParticlePool::~ParticlePool()
+{
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+// Sparks for destroyed bricks. Purely for show, so they live on the
+// render side and never feed back into the game.
+//
+// The pool is a ring buffer allocated once by Reserve. Every particle
+// lives the same time, so the ring is oldest first: expired ones drop off
+// the tail and a full ring overwrites its oldest. Nothing is allocated
+// per frame, at most Capacity() particles are ever updated or drawn, and
+// at most frame_budget are emitted per frame however many bricks go.
+
+#include <stdint.h>
+#include <vector>
+
+#include "Bricks.h"
+#include "Generator.h"
+
+class ParticlePool
+{
+public:
+  std::vector<float, AlignedAllocator<float> > pos_x;
+  std::vector<float, AlignedAllocator<float> > pos_y;
+  std::vector<float, AlignedAllocator<float> > speed_x;  // Pixels per second
+  std::vector<float, AlignedAllocator<float> > speed_y;
+  std::vector<float, AlignedAllocator<float> > age;      // Seconds
+  std::vector<uint32_t> color;                           // 0xRRGGBBAA
+
+  float lifetime;      // Seconds
+  float gravity;       // Pixels per second squared
+  int per_brick;       // Particles for each destroyed brick
+  int frame_budget;    // Emitted per frame at most
+
+  int emitted;         // This frame, since BeginFrame
+  int dropped;         // Refused this frame, over the budget
+
+  ParticlePool();
+
+  void Reserve(int capacity);  // Drops every particle
+
+  int Count() const
+  {
+    return count;
+  }
+
+  int Capacity() const
+  {
+    return capacity;
+  }
+
+  void BeginFrame();
+
+  bool Emit(float x, float y, float vx, float vy, uint32_t rgba);  // False over the budget
+
+  void EmitBrick(const BrickSoA& bricks, int i);
+
+  // Sparks for every brick alive in seen and gone in bricks, then seen
+  // takes bricks' live bits. Returns how many bricks went
+  int EmitDeaths(const BrickSoA& bricks, std::vector<uint64_t>& seen);
+
+  // Moves everything, then drops what is older than lifetime. Runs on
+  // the kernel BrickSoA::SelectedKernel() names
+  void Update(float seconds);
+
+  // Calls visit(slot) for every live particle, oldest first
+  template <class F>
+  void ForEach(F visit) const
+  {
+    int k, slot = Oldest();
+
+    for (k = 0; k < count; k++)
+    {
+      visit(slot);
+      if (++slot == capacity)
+        slot = 0;
+    }
+  }
+
+  ~ParticlePool();
+
+private:
+  int capacity;
+  int count;
+  int head;          // Next slot to write
+  Xoshiro256 random;
+
+  int Oldest() const
+  {
+    return head - count < 0 ? head - count + capacity : head - count;
+  }
+};
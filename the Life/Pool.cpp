@@ -0,0 +1,147 @@
+#include "Pool.h"
+
+WorkStealingPool::WorkStealingPool(int n)
+  : threads(n > 0 ? n : (int)std::max(1u, std::thread::hardware_concurrency())),
+    shares(threads)
+{
+  int k;
+
+  generation.store(0);
+  running.store(0);
+  stop.store(false);
+  steals.store(0);
+  task = NULL;
+  context = NULL;
+
+  for (k = 1; k < threads; k++)
+    workers.emplace_back(&WorkStealingPool::Worker, this, k);
+}
+
+void WorkStealingPool::RunTasks(int count, Task run, void* data)
+{
+  int k;
+
+  for (k = 0; k < threads; k++)
+    shares[k].bounds.store(Bounds((uint32_t)((int64_t)count * k / threads),
+                                  (uint32_t)((int64_t)count * (k + 1) / threads)));
+  steals.store(0);
+  task = run;
+  context = data;
+  running.store(threads - 1);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    generation.fetch_add(1, std::memory_order_release);
+  }
+  wake.notify_all();
+
+  Work(0);
+
+  while (running.load(std::memory_order_acquire) != 0)
+    std::this_thread::yield();
+}
+
+void WorkStealingPool::Worker(int worker)
+{
+  unsigned seen = 0;
+  int spins;
+
+  for (;;)
+  {
+    for (spins = 0; spins < SPINS && generation.load(std::memory_order_acquire) == seen &&
+                    !stop.load(std::memory_order_relaxed); spins++)
+      std::this_thread::yield();
+
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&]() { return generation.load(std::memory_order_acquire) != seen || stop.load(); });
+    }
+
+    if (stop.load())
+      return;
+
+    seen = generation.load(std::memory_order_acquire);
+    Work(worker);
+    running.fetch_sub(1, std::memory_order_release);
+  }
+}
+
+void WorkStealingPool::Work(int worker)
+{
+  int index;
+
+  while (Take(worker, index))
+    task(context, index, worker);
+}
+
+bool WorkStealingPool::Take(int worker, int& index)
+{
+  Share& own = shares[worker];
+  uint64_t bounds;
+  uint32_t first, end;
+
+  for (;;)
+  {
+    bounds = own.bounds.load(std::memory_order_acquire);
+    first = (uint32_t)(bounds >> 32);
+    end = (uint32_t)bounds;
+
+    if (first < end)
+    {
+      if (own.bounds.compare_exchange_weak(bounds, Bounds(first + 1, end), std::memory_order_acq_rel))
+      {
+        index = (int)first;
+        return true;
+      }
+    }
+    else if (!Steal(worker))
+      return false;
+  }
+}
+
+bool WorkStealingPool::Steal(int worker)
+{
+  uint64_t bounds;
+  uint32_t first, end, half;
+  int k, victim;
+
+  // Only this worker ever fills its own share, and only while it is empty,
+  // so a thief never takes from a share that is being refilled
+  for (k = 1; k < threads; k++)
+  {
+    victim = (worker + k) % threads;
+    bounds = shares[victim].bounds.load(std::memory_order_acquire);
+
+    for (;;)
+    {
+      first = (uint32_t)(bounds >> 32);
+      end = (uint32_t)bounds;
+      if (first >= end)
+        break;
+
+      half = (end - first + 1) / 2;
+      if (shares[victim].bounds.compare_exchange_weak(bounds, Bounds(first, end - half), std::memory_order_acq_rel))
+      {
+        shares[worker].bounds.store(Bounds(end - half, end), std::memory_order_release);
+        steals.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+  size_t k;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop.store(true);
+  }
+  wake.notify_all();
+
+  for (k = 0; k < workers.size(); k++)
+    workers[k].join();
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+// Threads working through the indices [0, count), for jobs of uneven
+// length like whole games. Every worker starts with an equal share and
+// takes from its front; one that runs dry steals the back half of the
+// first share it finds with anything left. A share is one 64-bit word,
+// first index high and end low, changed only by compare and swap, and
+// every share has a cache line of its own.
+//
+// The threads live as long as the pool. Between runs they spin for a
+// little while, since a batch stepped in a loop comes straight back, and
+// then sleep until the next Run.
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Bricks.h"
+
+class WorkStealingPool
+{
+public:
+  explicit WorkStealingPool(int threads = 0);  // 0 for one per hardware thread
+
+  int Threads() const
+  {
+    return threads;
+  }
+
+  // Calls task(index, worker) once for every index, worker in
+  // [0, Threads()), and returns when all are done. Worker 0 is the
+  // calling thread. Nothing is allocated
+  template <class F>
+  void Run(int count, F task)
+  {
+    RunTasks(count, [](void* context, int index, int worker) { (*(F*)context)(index, worker); }, &task);
+  }
+
+  long long Steals() const  // In the last Run
+  {
+    return steals.load();
+  }
+
+  ~WorkStealingPool();
+
+private:
+  typedef void (*Task)(void* context, int index, int worker);
+
+  struct alignas(64) Share
+  {
+    std::atomic<uint64_t> bounds;
+  };
+
+  enum { SPINS = 2000 };  // Yields before a waiting worker goes to sleep
+
+  int threads;
+  std::vector<Share, AlignedAllocator<Share, 64> > shares;
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::atomic<unsigned> generation;  // One more for every Run
+  std::atomic<int> running;          // Workers still in this Run
+  std::atomic<bool> stop;
+  std::atomic<long long> steals;
+  Task task;
+  void* context;
+
+  static uint64_t Bounds(uint32_t first, uint32_t end)
+  {
+    return (uint64_t)first << 32 | end;
+  }
+
+  void RunTasks(int count, Task task, void* context);
+  void Worker(int worker);
+  void Work(int worker);
+  bool Take(int worker, int& index);  // False when there is nothing left anywhere
+  bool Steal(int worker);
+};
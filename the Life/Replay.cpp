@@ -0,0 +1,277 @@
+// fopen is fine here, SDL checks would make it an error
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include "Replay.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char REPLAY_MAGIC[4] = { 'A', 'R', 'K', 'R' };
+
+static const uint64_t FNV_OFFSET = 0xcbf29ce484222325ULL;
+static const uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+// FNV-1a a word at a time, the state is words and floats
+static uint64_t HashWord(uint64_t hash, uint64_t word)
+{
+  return (hash ^ word) * FNV_PRIME;
+}
+
+static uint64_t HashFloat(uint64_t hash, float value)
+{
+  uint32_t bits;
+
+  memcpy(&bits, &value, sizeof(bits));
+  return HashWord(hash, bits);
+}
+
+static uint64_t HashFloats(uint64_t hash, const float* values, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    hash = HashFloat(hash, values[i]);
+
+  return hash;
+}
+
+// splitmix64's finalizer, so one changed state changes the whole chain
+static uint64_t Mix(uint64_t x)
+{
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static void PutVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+  while (value >= 0x80)
+  {
+    out.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((uint8_t)value);
+}
+
+// False when the bytes run out in the middle
+static bool GetVarint(const std::vector<uint8_t>& in, size_t& at, uint64_t& value)
+{
+  int shift;
+
+  value = 0;
+  for (shift = 0; at < in.size() && shift < 64; shift += 7)
+  {
+    value |= (uint64_t)(in[at] & 0x7F) << shift;
+    if ((in[at++] & 0x80) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+uint64_t StateHash(const Game& game)
+{
+  const Ball& ball = game.ball;
+  const Paddle& paddle = game.paddle;
+  const BallPool& balls = game.balls;
+  uint64_t hash = FNV_OFFSET;
+  size_t w;
+
+  // Not bricks_version, it counts on across resets; the live bits are the state
+  hash = HashWord(hash, (uint64_t)game.ticks);
+  hash = HashWord(hash, (uint64_t)(uint32_t)game.result);
+  hash = HashWord(hash, (uint64_t)(uint32_t)game.directionX << 32 | (uint32_t)game.directionY);
+
+  hash = HashFloat(hash, ball.pos_x);
+  hash = HashFloat(hash, ball.pos_y);
+  hash = HashFloat(hash, ball.speed_x);
+  hash = HashFloat(hash, ball.speed_y);
+  hash = HashFloat(hash, ball.radius);
+
+  hash = HashFloat(hash, paddle.pos_x);
+  hash = HashFloat(hash, paddle.pos_y);
+  hash = HashWord(hash, (uint64_t)(uint32_t)paddle.weight << 32 | (uint32_t)paddle.hight);
+
+  hash = HashWord(hash, (uint64_t)balls.Count());
+  hash = HashFloats(hash, balls.pos_x.data(), balls.Count());
+  hash = HashFloats(hash, balls.pos_y.data(), balls.Count());
+  hash = HashFloats(hash, balls.speed_x.data(), balls.Count());
+  hash = HashFloats(hash, balls.speed_y.data(), balls.Count());
+  hash = HashFloats(hash, balls.radius.data(), balls.Count());
+
+  for (w = 0; w < game.bricks.live.size(); w++)
+    hash = HashWord(hash, game.bricks.live[w]);
+
+  return hash;
+}
+
+ReplayRecorder::ReplayRecorder()
+{
+  memset(&header, 0, sizeof(header));
+  last.move = 0;
+  last.spawn = 0;
+  unchanged = 0;
+  ticks = 0;
+  chain = 0;
+}
+
+void ReplayRecorder::Start(const Game& game, int hash_interval)
+{
+  const LevelFile* level = game.Level();
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, REPLAY_MAGIC, 4);
+  header.version = REPLAY_VERSION;
+  header.tick_rate = (uint32_t)game.tick_rate;
+  header.hash_interval = (uint32_t)(hash_interval > 0 ? hash_interval : 1);
+  header.level = level ? level->Header().checksum : 0;
+  header.level_count = level ? level->Header().count : 0;
+  header.kernel = (uint32_t)BrickSoA::SelectedKernel();
+
+  inputs.clear();
+  hashes.clear();
+  last.move = 0;
+  last.spawn = 0;
+  unchanged = 0;
+  ticks = 0;
+  chain = Mix(StateHash(game));
+}
+
+void ReplayRecorder::Record(const GameInput& input, const Game& game)
+{
+  if (input.move != last.move || input.spawn != last.spawn)
+  {
+    PutVarint(inputs, unchanged);
+    inputs.push_back((uint8_t)((input.move + 1) | (input.spawn != 0 ? 4 : 0)));
+    if (input.spawn != 0)
+      PutVarint(inputs, (uint64_t)input.spawn);
+
+    last = input;
+    unchanged = 0;
+  }
+  else
+    unchanged++;
+
+  chain = Mix(chain ^ StateHash(game));
+  ticks++;
+
+  if (ticks % header.hash_interval == 0)
+    hashes.push_back(chain);
+}
+
+const char* ReplayRecorder::Write(const char* path) const
+{
+  ReplayHeader out = header;
+  FILE* file;
+  bool ok;
+
+  out.ticks = ticks;
+  out.input_bytes = inputs.size();
+  out.checkpoints = hashes.size() + (ticks % header.hash_interval != 0);
+
+  file = fopen(path, "wb");
+  if (file == NULL)
+    return "cannot create the replay file";
+
+  // The ticks after the last full window get a checkpoint of their own
+  ok = fwrite(&out, sizeof(out), 1, file) == 1 &&
+       fwrite(inputs.data(), 1, inputs.size(), file) == inputs.size() &&
+       fwrite(hashes.data(), sizeof(uint64_t), hashes.size(), file) == hashes.size() &&
+       (ticks % header.hash_interval == 0 || fwrite(&chain, sizeof(chain), 1, file) == 1);
+  ok = fclose(file) == 0 && ok;
+
+  return ok ? NULL : "cannot write the replay file";
+}
+
+ReplayRecorder::~ReplayRecorder()
+{
+}
+
+ReplayLog::ReplayLog()
+{
+  memset(&header, 0, sizeof(header));
+}
+
+const char* ReplayLog::Read(const char* path)
+{
+  FILE* file;
+  bool ok;
+
+  file = fopen(path, "rb");
+  if (file == NULL)
+    return "cannot open it";
+
+  ok = fread(&header, sizeof(header), 1, file) == 1;
+  if (ok && memcmp(header.magic, REPLAY_MAGIC, 4) != 0)
+  {
+    fclose(file);
+    return "not a replay";
+  }
+  if (ok && header.version != REPLAY_VERSION)
+  {
+    fclose(file);
+    return "replay version not supported";
+  }
+
+  // A checkpoint per started window, and no more input than ticks could need
+  ok = ok && header.tick_rate > 0 && header.hash_interval > 0 &&
+       header.checkpoints == (header.ticks + header.hash_interval - 1) / header.hash_interval &&
+       header.input_bytes <= header.ticks * 16;
+  if (ok)
+  {
+    inputs.resize((size_t)header.input_bytes);
+    hashes.resize((size_t)header.checkpoints);
+    ok = fread(inputs.data(), 1, inputs.size(), file) == inputs.size() &&
+         fread(hashes.data(), sizeof(uint64_t), hashes.size(), file) == hashes.size();
+  }
+  fclose(file);
+
+  return ok ? NULL : "replay truncated or damaged";
+}
+
+long long ReplayLog::Play(Game& game) const
+{
+  GameInput input;
+  uint64_t chain = Mix(StateHash(game));
+  uint64_t t, skip = 0, spawn;
+  size_t at = 0;
+  bool more;
+  int code;
+
+  input.move = 0;
+  input.spawn = 0;
+
+  more = GetVarint(inputs, at, skip);
+
+  for (t = 0; t < header.ticks; t++)
+  {
+    // The input changes on this tick
+    if (more && skip == 0)
+    {
+      code = at < inputs.size() ? inputs[at++] : 0;
+      input.move = (code & 3) - 1;
+      input.spawn = 0;
+      if ((code & 4) != 0 && GetVarint(inputs, at, spawn))
+        input.spawn = (int)spawn;
+
+      more = at < inputs.size() && GetVarint(inputs, at, skip);
+    }
+    else if (more)
+      skip--;
+
+    game.Step(input);
+    chain = Mix(chain ^ StateHash(game));
+
+    if ((t + 1) % header.hash_interval == 0 || t + 1 == header.ticks)
+      if (chain != hashes[t / header.hash_interval])
+        return (long long)(t / header.hash_interval * header.hash_interval);
+  }
+
+  return -1;
+}
+
+ReplayLog::~ReplayLog()
+{
+}
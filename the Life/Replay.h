@@ -0,0 +1,98 @@
+#pragma once
+
+// Sessions recorded tick by tick, so any game can be played again
+// exactly, without a window and as fast as the CPU allows.
+//
+// A game is decided by its level, its tick rate and the input of every
+// tick, so a log holds just those. Inputs are stored as changes only:
+// a varint count of ticks the input stayed the same, then the new input
+// byte, (move + 1) | 4 when balls were launched, followed by their count
+// as a varint. A hash of the whole state after every tick is chained into
+// one value, and every hash_interval ticks that value is kept, so a
+// replay tells in which window it first went differently.
+//
+//   ReplayHeader                     56 bytes
+//   uint8_t  inputs[input_bytes]
+//   uint64_t hashes[checkpoints]     the last one covers the final ticks
+//
+// Little endian. The game has no randomness of its own; the level's
+// checksum and brick count stand in for a seed.
+
+#include <stdint.h>
+#include <vector>
+
+#include "Game.h"
+
+struct ReplayHeader
+{
+  char magic[4];           // "ARKR"
+  uint32_t version;        // REPLAY_VERSION
+  uint32_t tick_rate;
+  uint32_t hash_interval;  // Ticks per checkpoint
+  uint32_t level;          // LevelHeader checksum, 0 for the classic level
+  uint32_t level_count;    // Its bricks
+  uint32_t kernel;         // BrickSoA kernel the extra balls moved with
+  uint32_t reserved;
+  uint64_t ticks;
+  uint64_t input_bytes;
+  uint64_t checkpoints;
+};
+
+enum
+{
+  REPLAY_VERSION = 1
+};
+
+// Everything that decides the next ticks: balls, paddle, live bricks
+uint64_t StateHash(const Game& game);
+
+class ReplayRecorder
+{
+public:
+  ReplayRecorder();
+
+  // Starts a new log for game as it is now, before its first tick
+  void Start(const Game& game, int hash_interval);
+
+  // After every game.Step(input)
+  void Record(const GameInput& input, const Game& game);
+
+  long long Ticks() const
+  {
+    return (long long)ticks;
+  }
+
+  // NULL on success, else what went wrong
+  const char* Write(const char* path) const;
+
+  ~ReplayRecorder();
+
+private:
+  ReplayHeader header;
+  std::vector<uint8_t> inputs;
+  std::vector<uint64_t> hashes;
+  GameInput last;         // Input of the tick before
+  uint64_t unchanged;     // Ticks since last changed
+  uint64_t ticks;
+  uint64_t chain;
+};
+
+class ReplayLog
+{
+public:
+  ReplayHeader header;
+  std::vector<uint8_t> inputs;
+  std::vector<uint64_t> hashes;
+
+  ReplayLog();
+
+  // NULL on success, else what is wrong with the file
+  const char* Read(const char* path);
+
+  // Plays the log on game, which has to be reset to the level the log
+  // was recorded on. Returns the first tick of the first checkpoint
+  // window that hashes differently, -1 when every one matches
+  long long Play(Game& game) const;
+
+  ~ReplayLog();
+};
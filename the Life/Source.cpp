@@ -1,64 +1,139 @@
 #include "Header.h"
+#include "Replay.h"
+#include "TripleBuffer.h"
 
 int SCREEN_WIDTH = 640;
 int SCREEN_HEIGHT = 480;
+Game game;          // All game state, owned by the simulation thread
+ReplayRecorder recorder;  // Every tick of the session, also the simulation thread's
 Circle A;
 Platform P;
-Brick R[5];
-int MAX;
-int BRICK_COUNTER;
+BrickBatch B;
+BrickLayer L;
+GeometryBatch G;
+FrameTimer timing;  // Per phase histograms, fed by both threads
+
+// The only state shared between the two threads
+TripleBuffer<GameSnapshot> snapshots;   // Simulation -> main thread
+std::atomic<int> input_move;            // Main -> simulation thread, GameInput::move
+std::atomic<int> input_spawn;           // Balls asked for since the last tick, GameInput::spawn
+std::atomic<bool> stop_simulation;
+
+static void PublishSnapshot(const Ball& previous_ball, const Paddle& previous_paddle, Uint64 tick_time)
+{
+  GameSnapshot& snapshot = snapshots.Back();
 
-int directionY = 1;
-int directionX = 1;
-bool bNeedMove = false;
+  game.Snapshot(snapshot);
+  snapshot.previous_ball = previous_ball;
+  snapshot.previous_paddle = previous_paddle;
+  snapshot.tick_time = tick_time;
+  snapshots.Publish();
+}
 
-Uint32 my_callbackfunc(Uint32 interval, void* param)
+// Fixed ticks on their own thread. Each batch of ticks is published as a
+// snapshot, the main thread never touches game directly
+static int SimulationThread(void*)
 {
-  SDL_Event event;
+  Uint64 frequency = SDL_GetPerformanceFrequency();
+  Uint64 tick_length = frequency / game.tick_rate;
+  Uint64 next = SDL_GetPerformanceCounter() + tick_length;  // When the next tick is due
+  Uint64 now;
+  Ball previous_ball = game.ball;
+  Paddle previous_paddle = game.paddle;
+  GameInput input;
+  bool stepped;
+
+  TRACE_THREAD("Simulation");
+
+  while (!stop_simulation.load(std::memory_order_relaxed) && game.result == Game::PLAYING)
+  {
+    now = SDL_GetPerformanceCounter();
 
-  SDL_UserEvent userevent;
-  
-  int i;
+    if ((Sint64)(now - next) > (Sint64)(frequency / 4)) // Don't try to catch up after a stall
+      next = now;
+
+    stepped = false;
+    input.move = input_move.load(std::memory_order_relaxed);
+
+    while ((Sint64)(now - next) >= 0 && game.result == Game::PLAYING)
+    {
+      input.spawn = input_spawn.exchange(0, std::memory_order_relaxed);
 
-  /* In this example, our callback pushes an SDL_USEREVENT event
-     into the queue, and causes our callback to be called again at the
-     same interval: */
+      previous_ball = game.ball;
+      previous_paddle = game.paddle;
+      {
+        PhaseScope scope(timing, PHASE_TICK);
+        game.Step(input);
+      }
+      recorder.Record(input, game);
+      next += tick_length;
+      stepped = true;
+    }
 
-  if (A.pos_y < 10) // directionY = FUNK_Y(pos_x, pos_y);
-    directionY = 1;
+    if (stepped)
+      PublishSnapshot(previous_ball, previous_paddle, next - tick_length);
 
-  if (A.pos_y > SCREEN_HEIGHT - 30)
-    directionY = -1;
+    // Sleep until the next tick, SDL_Delay has millisecond resolution
+    now = SDL_GetPerformanceCounter();
+    if ((Sint64)(next - now) > 0)
+      SDL_Delay((Uint32)((next - now) * 1000 / frequency) + 1);
+  }
 
-  if (A.pos_x < 10) // directionX = FUNK_X();
-    directionX = 1;
+  return 0;
+}
 
-  if (A.pos_x > SCREEN_WIDTH - 30)
-    directionX = -1;
+long long events_processed = 0;         // Compared with frames presented on exit
+bool window_exposed = false;            // The window needs presenting in full
+bool show_timing = false;               // F3, the phase timing overlay
 
-  if (A.pos_y < P.pos_y + P.hight && P.pos_y - P.hight < A.pos_y && A.pos_x < P.pos_x + P.weight && P.pos_x < A.pos_x)
-    directionY = -1;
+static void HandleEvent(const SDL_Event& event, bool& quit)
+{
+  events_processed++;
 
-  for (i = 0; i < MAX; i++)
+  // Closing the window
+  if (event.type == SDL_QUIT)
   {
-    if (R[i].print == true && A.pos_y - 10 < R[i].pos_y + R[i].hight && A.pos_y + 10 > R[i].pos_y && A.pos_x > R[i].pos_x && A.pos_x < R[i].pos_x + R[i].weight)
-    {
-      directionY = 1;
-      R[i].print = false;
-      BRICK_COUNTER += 1;
-    }
+    quit = true;
+    printf("\n\nYOU CLOSED THE GAME\n\n");
   }
 
-  userevent.type = SDL_USEREVENT;
-  userevent.code = 0;
-  userevent.data1 = NULL;
-  userevent.data2 = NULL;
+  // Space launches a fan of extra balls
+  if (event.type == SDL_KEYDOWN && event.key.keysym.scancode == SDL_SCANCODE_SPACE && !event.key.repeat)
+    input_spawn.fetch_add(8, std::memory_order_relaxed);
+
+  // Target textures lose what was drawn into them
+  if (event.type == SDL_RENDER_TARGETS_RESET || event.type == SDL_RENDER_DEVICE_RESET)
+    L.lost = true;
+
+  if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_EXPOSED)
+    window_exposed = true;
+
+  if (event.type == SDL_KEYDOWN && event.key.keysym.scancode == SDL_SCANCODE_F3 && !event.key.repeat)
+    show_timing = !show_timing;
+}
+
+// Take everything queued since the last frame, then hand the held keys
+// to the simulation. Nothing here draws, the frame is rendered once after
+static void DrainInput(const Uint8* keys, bool& quit)
+{
+  SDL_Event event;
+  int move = 0;
 
-  event.type = SDL_USEREVENT;
-  event.user = userevent;
-  bNeedMove = true;
-  SDL_PushEvent(&event);
-  return(interval);
+  while (SDL_PollEvent(&event))
+    HandleEvent(event, quit);
+
+  // Moving the ractangle while the key is held
+  if (keys[SDL_SCANCODE_LEFT])
+    move -= 1;
+  if (keys[SDL_SCANCODE_RIGHT])
+    move += 1;
+  input_move.store(move, std::memory_order_relaxed);
+}
+
+// Linear blend between the last two simulation states
+static int Lerp(float previous, float current, double alpha)
+{
+  return (int)floor(previous + (current - previous) * alpha + 0.5);
 }
 
 int main(int argc, char* argv[])
@@ -67,51 +142,102 @@ int main(int argc, char* argv[])
   SDL_Renderer* renderer;
   SDL_Event event;
 
+  SDL_RendererInfo info;
+
   bool quit = false;
   int i;                                 // Counter
 
-  MAX = 4;
-  BRICK_COUNTER = 0;
-
-  A.pos_x = 260;
-  A.pos_y = 300;
-  A.speed_x = 1;
-  A.speed_y = 1;
-
-  P.pos_x = 220;
-  P.pos_y = 430;
-  P.hight = 20;
-  P.weight = 200;
-  P.speed_x = 10;
-
-  R[0].pos_x = 10;
-  R[0].pos_y = 10;
-  R[0].hight = 70;
-  R[0].weight = 150;
-  R[0].print = true;
-
-  R[1].pos_x = 170;
-  R[1].pos_y = 10;
-  R[1].hight = 70;
-  R[1].weight = 150;
-  R[1].print = true;
-
-  R[2].pos_x = 330;
-  R[2].pos_y = 10;
-  R[2].hight = 70;
-  R[2].weight = 150;
-  R[2].print = true;
-
-  R[3].pos_x = 490;
-  R[3].pos_y = 10;
-  R[3].hight = 70;
-  R[3].weight = 140;
-  R[3].print = true;
+  Uint64 frame_start;                    // Frame time, for comparing render drivers
+  Uint64 frame_ticks = 0;
+  int frames = 0;
+  long long draw_calls = 0;              // SDL_RenderGeometry submissions
+
+  int bricks_version = -1;               // game.bricks_version the batch was built from
+
+  ParticlePool particles;                // Debris of destroyed bricks
+  std::vector<uint64_t> seen;            // Live bits the particles last looked at
+  Uint64 last_frame = 0;                 // frame_start of the frame before
+  float frame_seconds;
+
+  bool dirty_present = false;            // Draw into the window surface, present only what changed
+  bool cached;                           // L holds the bricks this frame
+  DirtyRects dirty;                      // To redraw and present this frame
+  DirtyRects moving;                     // Paddle, balls and particles as drawn last frame
+  SDL_Rect rect;
+  long long dirty_pixels = 0;            // Presented since the start, in dirty mode
+  long long report_pixels = 0;           // The same since the report
+
+  int tick_rate = 120;                   // Simulation ticks per second
+  Uint64 tick_length;                    // In performance counter units
+  double alpha;                          // How far we are between the last two ticks
+  const Uint8* keys;
+  SDL_Thread* simulation;
+
+  const char* level_path = NULL;         // Binary level, see Level.h
+  const char* record_path = "last_session.rep";  // The session's replay, see Replay.h
+  const char* timing_path = "timing.json";       // Phase histograms of the whole run
+  const char* trace_path = NULL;                 // Chrome trace of both threads, Trace build only
+  char title[256];
+  std::shared_ptr<LevelFile> level;
+  const char* error;
+
+  int frame_rate = 60;                   // Frames per second
+  Uint64 frequency;
+  Uint64 frame_length;
+  Uint64 next_frame;                     // Deadline of the next frame
+  Uint64 now;
+  int wait;                              // Milliseconds left to the deadline
+
+  Uint64 report_start;                   // CPU use, reported once a second
+  double cpu_start, cpu_now;
+  int report_frames = 0;
+  long long report_events = 0;
+
+  // the Life.exe [--tick 60|120|240|1000] [--fps 60] [--driver software|opengl] [--level file]
+  //              [--present full|dirty] [--record file] [--timing file] [--trace file]
+  for (i = 1; i + 1 < argc; i += 2)
+  {
+    if (strcmp(argv[i], "--tick") == 0 && atoi(argv[i + 1]) > 0)
+      tick_rate = atoi(argv[i + 1]);
+    if (strcmp(argv[i], "--fps") == 0 && atoi(argv[i + 1]) > 0)
+      frame_rate = atoi(argv[i + 1]);
+    if (strcmp(argv[i], "--driver") == 0)
+      SDL_SetHint(SDL_HINT_RENDER_DRIVER, argv[i + 1]);
+    if (strcmp(argv[i], "--level") == 0)
+      level_path = argv[i + 1];
+    if (strcmp(argv[i], "--present") == 0)
+      dirty_present = strcmp(argv[i + 1], "dirty") == 0;
+    if (strcmp(argv[i], "--record") == 0)
+      record_path = argv[i + 1];
+    if (strcmp(argv[i], "--timing") == 0)
+      timing_path = argv[i + 1];
+    if (strcmp(argv[i], "--trace") == 0)
+      trace_path = argv[i + 1];
+  }
+
+  game.SetTickRate(tick_rate);
+  game.Reset();
+
+  if (level_path != NULL)
+  {
+    level = OpenLevel(level_path);
+    error = level ? game.SetLevel(level) : "cannot open it";
+    if (error != NULL)
+      printf("Level %s: %s, playing the classic level\n", level_path, error);
+  }
+
+  // The window is the level's play area
+  SCREEN_WIDTH = game.width;
+  SCREEN_HEIGHT = game.height;
+
+  input_move.store(0);
+  input_spawn.store(0);
+  stop_simulation.store(false);
 
   SDL_Init(SDL_INIT_VIDEO);              // Initialize SDL
 
-  Uint32 delay = (33 / 10) * 10;  /* To round it down to the nearest 10 ms */
-  SDL_TimerID my_timer_id = SDL_AddTimer(delay, my_callbackfunc, 0);// my_callback_param);
+  // Widest brick kernel this CPU runs
+  BrickSoA::SelectKernel(SDL_HasAVX2() ? BrickSoA::AVX2 : SDL_HasSSE2() ? BrickSoA::SSE2 : BrickSoA::SCALAR);
 
   // Create a window
   window = SDL_CreateWindow(
@@ -120,7 +246,7 @@ int main(int argc, char* argv[])
     SDL_WINDOWPOS_UNDEFINED,           // initial y position
     SCREEN_WIDTH,                               // width, in pixels
     SCREEN_HEIGHT,                               // height, in pixels
-    SDL_WINDOW_OPENGL                  // flags - see below
+    dirty_present ? 0 : SDL_WINDOW_OPENGL  // flags - see below
   );
 
   // Check that the window was successfully created
@@ -129,8 +255,25 @@ int main(int argc, char* argv[])
     return 1;
   }
 
+  // Dirty rect presentation draws straight into the window surface and
+  // sends only what changed with SDL_UpdateWindowSurfaceRects
+  renderer = NULL;
+  if (dirty_present)
+  {
+    renderer = SDL_CreateSoftwareRenderer(SDL_GetWindowSurface(window));
+    if (renderer == NULL)
+    {
+      printf("No window surface (%s), presenting in full\n", SDL_GetError());
+      dirty_present = false;
+    }
+  }
+
   // We must call SDL_CreateRenderer in order for draw calls to affect this window.
-  renderer = SDL_CreateRenderer(window, -1, 0);
+  if (renderer == NULL)
+    renderer = SDL_CreateRenderer(window, -1, 0);
+
+  dirty.SetBounds(SCREEN_WIDTH, SCREEN_HEIGHT);
+  moving.SetBounds(SCREEN_WIDTH, SCREEN_HEIGHT);
 
   // Set the color for drawing.
   SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
@@ -138,68 +281,303 @@ int main(int argc, char* argv[])
   // Clear the entire screen to our selected color.
   SDL_RenderClear(renderer);
 
+  keys = SDL_GetKeyboardState(NULL);
+
+  frequency = SDL_GetPerformanceFrequency();
+  tick_length = frequency / tick_rate;
+  frame_length = frequency / frame_rate;
+
+  // First snapshot before the thread starts, so there is always one to draw
+  PublishSnapshot(game.ball, game.paddle, SDL_GetPerformanceCounter());
+  recorder.Start(game, 60);
+
+  if (trace_path != NULL)
+  {
+    error = TraceStart(trace_path);
+    if (error != NULL)
+      printf("Trace %s: %s\n", trace_path, error);
+    TRACE_THREAD("Main");
+  }
+
+  simulation = SDL_CreateThread(SimulationThread, "Simulation", NULL);
+
+  // 64k particles at most, 4096 new ones a frame: a whole 10k brick level
+  // going at once costs no more than that
+  particles.Reserve(65536);
+  particles.frame_budget = 4096;
+
+  next_frame = SDL_GetPerformanceCounter();
+  report_start = next_frame;
+  last_frame = next_frame;
+  cpu_start = ProcessCpuSeconds();
+
   while (!quit)
   {
-    while (SDL_PollEvent(&event))
+    // Sleep until the frame deadline, waking up early only for events
+    while (!quit)
     {
-      SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-      SDL_RenderClear(renderer);
+      now = SDL_GetPerformanceCounter();
+      if ((Sint64)(next_frame - now) <= 0)
+        break;
 
-      for (i = 0; i < MAX; i++)
-        if (R[i].print == true)
-          R[i].Draw(window, renderer, 255, 0, 255, 255); // Draw the ractangle
-      
-      P.Draw(window, renderer, 255, 255, 255, 255); // Draw the main ractangle
+      wait = (int)((next_frame - now) * 1000 / frequency);
+      if (wait < 2)
+      {
+        SleepUntil(next_frame);
+        break;
+      }
 
-      // Moving circle
-      if (bNeedMove == true)
+      if (SDL_WaitEventTimeout(&event, wait - 1))
+        HandleEvent(event, quit);
+    }
+
+    {
+      PhaseScope scope(timing, PHASE_INPUT);
+      DrainInput(keys, quit);
+    }
+
+    frame_start = SDL_GetPerformanceCounter();
+
+    next_frame += frame_length;
+    if ((Sint64)(frame_start - next_frame) > 0) // Missed a whole frame, don't try to catch up
+      next_frame = frame_start + frame_length;
+
+    // Latest state from the simulation thread
+    snapshots.Update();
+    const GameSnapshot& state = snapshots.Front();
+
+    alpha = (double)(Sint64)(SDL_GetPerformanceCounter() - state.tick_time) / tick_length;
+    if (alpha < 0)
+      alpha = 0;
+    if (alpha > 1)
+      alpha = 1;
+
+    frame_seconds = (float)(frame_start - last_frame) / frequency;
+    if (frame_seconds > 0.1f)
+      frame_seconds = 0.1f;
+    last_frame = frame_start;
+
+    particles.BeginFrame();
+
+    if (bricks_version != state.bricks_version)
+    {
+      B.dirty = true;
+      bricks_version = state.bricks_version;
+      particles.EmitDeaths(state.bricks, seen);
+    }
+
+    {
+      PhaseScope scope(timing, PHASE_PARTICLES);
+      particles.Update(frame_seconds);
+    }
+
+    {
+      PhaseScope scope(timing, PHASE_BRICKS);
+
+      cached = L.Update(renderer, state.bricks, state.bricks_version);
+
+      // Where things were last frame, where bricks went and, when the
+      // layer was redrawn or the window uncovered, everything
+      if (dirty_present)
       {
-        A.pos_y = A.pos_y + directionY * A.speed_y * 10;
-        A.pos_x = A.pos_x + directionX * A.speed_x * 10;
-        bNeedMove = false;
+        dirty.Clear();
+        for (i = 0; i < moving.Count(); i++)
+          dirty.Add(moving.Rects()[i]);
+        moving.Clear();
+
+        for (i = 0; i < (int)L.Holes().size(); i++)
+          dirty.Add(L.Holes()[i]);
+
+        if (!cached || L.redrawn || window_exposed)
+          dirty.AddAll();
+        window_exposed = false;
       }
 
-      A.Draw(renderer);
-      
-      // You are loose
-      if (A.pos_y > SCREEN_HEIGHT - 30)
+      // Draw the ractangles: one copy of the cached layer, or every brick
+      // where the renderer can't draw to a texture. The dirty mode copies
+      // only its rects, once it knows them all
+      if (!cached || !dirty_present)
+      {
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+        SDL_RenderClear(renderer);
+      }
+      if (cached && !dirty_present)
+        L.Draw(renderer);
+      if (!cached)
       {
-        quit = true;
-        printf("\n\nYOU LOSE\n\n");
+        if (B.dirty)
+          B.Rebuild(state.bricks);
+        B.Draw(G);
       }
+    }
 
-      // You are win
-      if (BRICK_COUNTER == 4)
+    {
+      PhaseScope scope(timing, PHASE_SPRITES);
+
+      DrawParticles(particles, G);
+      if (dirty_present)
+        moving.Add(ParticleBounds(particles));
+
+      P.pos_x = Lerp(state.previous_paddle.pos_x, state.paddle.pos_x, alpha);
+      P.pos_y = Lerp(state.previous_paddle.pos_y, state.paddle.pos_y, alpha);
+      P.hight = state.paddle.hight;
+      P.weight = state.paddle.weight;
+      P.Draw(G, { 255, 255, 255, 255 }); // Draw the main ractangle
+      rect = { P.pos_x, P.pos_y, P.weight, P.hight };
+      if (dirty_present)
+        moving.Add(rect);
+
+      A.pos_x = Lerp(state.previous_ball.pos_x, state.ball.pos_x, alpha);
+      A.pos_y = Lerp(state.previous_ball.pos_y, state.ball.pos_y, alpha);
+      A.radius = (int)state.ball.radius;
+      A.Draw(renderer, G);
+      rect = { A.pos_x, A.pos_y, 2 * A.radius, 2 * A.radius };
+      if (dirty_present)
+        moving.Add(rect);
+
+      // Extra balls at their latest position, same texture so no extra draw call
+      for (i = 0; i < state.balls.Count(); i++)
       {
-        quit = true;
-        printf("\n\nYOU WIN\n\nCONGRADULATIONS!\n\n");
+        A.pos_x = (int)floorf(state.balls.pos_x[i] + 0.5f);
+        A.pos_y = (int)floorf(state.balls.pos_y[i] + 0.5f);
+        A.radius = (int)state.balls.radius[i];
+        A.Draw(renderer, G);
+        rect = { A.pos_x, A.pos_y, 2 * A.radius, 2 * A.radius };
+        if (dirty_present)
+          moving.Add(rect);
       }
+    }
+
+    // Last second's phase times over everything, see Timing.h
+    if (show_timing)
+    {
+      rect = DrawTiming(timing, frame_length * 1000000000 / frequency, G);
+      if (dirty_present)
+        moving.Add(rect);
+    }
+
+    // Background back under the dirty rects, the new positions included
+    if (dirty_present)
+    {
+      PhaseScope scope(timing, PHASE_RESTORE);
+
+      for (i = 0; i < moving.Count(); i++)
+        dirty.Add(moving.Rects()[i]);
+      if (cached)
+        for (i = 0; i < dirty.Count(); i++)
+          L.Draw(renderer, dirty.Rects()[i]);
+    }
+
+    // The whole scene goes out in one call per texture
+    {
+      PhaseScope scope(timing, PHASE_FLUSH);
+      G.Flush(renderer);
+    }
+    draw_calls += G.draw_calls;
+
+    // You are loose
+    if (state.result == Game::LOSE)
+    {
+      quit = true;
+      printf("\n\nYOU LOSE\n\n");
+    }
+
+    // You are win
+    if (state.result == Game::WIN)
+    {
+      quit = true;
+      printf("\n\nYOU WIN\n\nCONGRADULATIONS!\n\n");
+    }
 
 // Up until now everything was drawn behind the scenes.
 // This will show the new, red contents of the window.
-      SDL_RenderPresent(renderer);
+    {
+      PhaseScope scope(timing, PHASE_PRESENT);
 
-      if (event.type == SDL_KEYDOWN) // If the keyboard button is pressed 
-      {
-        switch (event.key.keysym.sym)
-        {
-        case SDLK_LEFT:  P.pos_x -= P.speed_x; break; // Moving the ractangle left
-        case SDLK_RIGHT: P.pos_x += P.speed_x; break; // Moving the ractangle right
-        }
-        break;
-      }
+      SDL_RenderPresent(renderer);
+      if (dirty_present)
+        SDL_UpdateWindowSurfaceRects(window, dirty.Rects(), dirty.Count());
+    }
+    if (dirty_present)
+    {
+      dirty_pixels += dirty.Pixels();
+      report_pixels += dirty.Pixels();
+    }
 
-      SDL_RenderClear(renderer);
+    now = SDL_GetPerformanceCounter();
+    frame_ticks += now - frame_start;
+    timing.Add(PHASE_FRAME, now - frame_start);
+    TRACE_COMPLETE(PhaseName(PHASE_FRAME), frame_start, now);
+    frames++;
+    report_frames++;
 
-      // Closing the window
-      if (event.type == SDL_QUIT)
+    if (now - report_start >= frequency)
+    {
+      cpu_now = ProcessCpuSeconds();
+      printf("CPU %.1f%%, %d frames, %lld events, %d particles, %.1f us particle update per frame\n",
+             100.0 * (cpu_now - cpu_start) * frequency / (now - report_start), report_frames,
+             events_processed - report_events, particles.Count(),
+             timing.recent[PHASE_PARTICLES].Mean() / 1000);
+      if (dirty_present)
+        printf("Dirty rects: %.1f%% of the frame presented, %.0f pixels saved per frame\n",
+               100.0 * report_pixels / ((double)SCREEN_WIDTH * SCREEN_HEIGHT * report_frames),
+               ((double)SCREEN_WIDTH * SCREEN_HEIGHT * report_frames - report_pixels) / report_frames);
+      cpu_start = cpu_now;
+      report_start = now;
+      report_frames = 0;
+      report_events = events_processed;
+      report_pixels = 0;
+
+      // The overlay shows the second just gone, the title its numbers
+      timing.Roll();
+      if (show_timing)
       {
-        quit = true;
-        printf("\n\nYOU CLOSED THE GAME\n\n");
+        snprintf(title, sizeof(title), "Arcanoid - frame p50 %.2f p99 %.2f ms, tick p99 %.1f us, present p99 %.2f ms",
+                 timing.shown[PHASE_FRAME].p50 / 1e6, timing.shown[PHASE_FRAME].p99 / 1e6,
+                 timing.shown[PHASE_TICK].p99 / 1e3, timing.shown[PHASE_PRESENT].p99 / 1e6);
+        SDL_SetWindowTitle(window, title);
       }
+      else
+        SDL_SetWindowTitle(window, "Arcanoid");
     }
   }
 
+  if (frames > 0 && SDL_GetRendererInfo(renderer, &info) == 0)
+    printf("Renderer %s: %d frames, average frame time %.3f ms, %.2f draw calls per frame\n",
+           info.name, frames, 1000.0 * frame_ticks / frames / SDL_GetPerformanceFrequency(),
+           (double)draw_calls / frames);
+
+  printf("%d frames presented, %lld events processed\n", frames, events_processed);
+
+  if (dirty_present && frames > 0)
+    printf("Dirty rects: %.1f%% of the pixels presented over the run\n",
+           100.0 * dirty_pixels / ((double)SCREEN_WIDTH * SCREEN_HEIGHT * frames));
+
+  stop_simulation.store(true);
+  SDL_WaitThread(simulation, NULL);
+  TraceStop();
+
+  printf("%10s %10s %10s %10s %10s %10s   (us)\n", "phase", "count", "p50", "p95", "p99", "max");
+  for (i = 0; i < PHASE_COUNT; i++)
+    printf("%10s %10llu %10.1f %10.1f %10.1f %10.1f\n", PhaseName(i), (unsigned long long)timing.run[i].Count(),
+           timing.run[i].Percentile(0.50) / 1e3, timing.run[i].Percentile(0.95) / 1e3,
+           timing.run[i].Percentile(0.99) / 1e3, timing.run[i].Max() / 1e3);
+
+  error = timing.WriteJson(timing_path);
+  if (error != NULL)
+    printf("Timing %s: %s\n", timing_path, error);
+
+  // Headless --replay plays it again
+  error = recorder.Write(record_path);
+  if (error != NULL)
+    printf("Replay %s: %s\n", record_path, error);
+  else
+    printf("%lld ticks recorded to %s\n", recorder.Ticks(), record_path);
+
+  A.Release();
+  L.Release();
+  SDL_DestroyRenderer(renderer);
+
   // Close and destroy the window
   SDL_DestroyWindow(window);
 
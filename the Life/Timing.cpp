@@ -0,0 +1,197 @@
+// fopen is fine here, SDL checks would make it an error
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include "Timing.h"
+
+#include <stdio.h>
+
+#include "Bits.h"
+
+static const char* PHASE_NAMES[PHASE_COUNT] =
+{
+  "input", "tick", "particles", "bricks", "sprites", "restore", "flush", "present", "frame"
+};
+
+const char* PhaseName(int phase)
+{
+  return phase >= 0 && phase < PHASE_COUNT ? PHASE_NAMES[phase] : "?";
+}
+
+PhaseHistogram::PhaseHistogram()
+{
+  Clear();
+}
+
+int PhaseHistogram::Bucket(uint64_t nanoseconds)
+{
+  int high;
+
+  if (nanoseconds < 16)
+    return (int)nanoseconds;
+
+  // The top bit picks the power of two, the three under it the eighth
+  high = HighestBit64(nanoseconds);
+  return 16 + (high - 4) * 8 + (int)(nanoseconds >> (high - 3) & 7);
+}
+
+uint64_t PhaseHistogram::BucketTop(int bucket)
+{
+  int high, shift;
+
+  if (bucket < 16)
+    return (uint64_t)bucket;
+
+  high = (bucket - 16) / 8 + 4;
+  shift = high - 3;
+  return ((uint64_t)(8 + (bucket - 16) % 8) << shift) + ((uint64_t)1 << shift) - 1;
+}
+
+void PhaseHistogram::Add(uint64_t nanoseconds)
+{
+  uint64_t seen = max.load(std::memory_order_relaxed);
+
+  counts[Bucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+  total.fetch_add(1, std::memory_order_relaxed);
+  sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+  while (nanoseconds > seen && !max.compare_exchange_weak(seen, nanoseconds, std::memory_order_relaxed))
+  {
+  }
+}
+
+uint64_t PhaseHistogram::Count() const
+{
+  return total.load(std::memory_order_relaxed);
+}
+
+uint64_t PhaseHistogram::Max() const
+{
+  return max.load(std::memory_order_relaxed);
+}
+
+double PhaseHistogram::Mean() const
+{
+  uint64_t n = Count();
+
+  return n > 0 ? (double)sum.load(std::memory_order_relaxed) / n : 0.0;
+}
+
+uint64_t PhaseHistogram::Percentile(double p) const
+{
+  uint64_t n = 0, rank, seen = 0, top = Max();
+  int b;
+
+  // Counted from the buckets, they may be a sample ahead of total
+  for (b = 0; b < BUCKETS; b++)
+    n += BucketCount(b);
+  if (n == 0)
+    return 0;
+
+  rank = (uint64_t)(p * n);
+  if (rank >= n)
+    rank = n - 1;
+
+  for (b = 0; b < BUCKETS; b++)
+  {
+    seen += BucketCount(b);
+    if (seen > rank)
+      return BucketTop(b) < top ? BucketTop(b) : top;
+  }
+
+  return top;
+}
+
+void PhaseHistogram::Clear()
+{
+  int b;
+
+  for (b = 0; b < BUCKETS; b++)
+    counts[b].store(0, std::memory_order_relaxed);
+  total.store(0, std::memory_order_relaxed);
+  sum.store(0, std::memory_order_relaxed);
+  max.store(0, std::memory_order_relaxed);
+}
+
+PhaseHistogram::~PhaseHistogram()
+{
+}
+
+FrameTimer::FrameTimer()
+{
+  int i;
+
+  nanoseconds_per_tick = 1e9 / SDL_GetPerformanceFrequency();
+  for (i = 0; i < PHASE_COUNT; i++)
+    shown[i] = Summary{ 0, 0, 0, 0, 0 };
+}
+
+void FrameTimer::Add(int phase, Uint64 ticks)
+{
+  uint64_t nanoseconds = (uint64_t)(ticks * nanoseconds_per_tick);
+
+  run[phase].Add(nanoseconds);
+  recent[phase].Add(nanoseconds);
+}
+
+void FrameTimer::Roll()
+{
+  int i;
+
+  for (i = 0; i < PHASE_COUNT; i++)
+  {
+    shown[i].count = recent[i].Count();
+    shown[i].p50 = recent[i].Percentile(0.50);
+    shown[i].p95 = recent[i].Percentile(0.95);
+    shown[i].p99 = recent[i].Percentile(0.99);
+    shown[i].max = recent[i].Max();
+    recent[i].Clear();
+  }
+}
+
+const char* FrameTimer::WriteJson(const char* path) const
+{
+  FILE* file;
+  const char* separator;
+  bool ok;
+  int i, b;
+
+  file = fopen(path, "w");
+  if (file == NULL)
+    return "cannot create the timing file";
+
+  // Microseconds for people, the non-empty buckets in nanoseconds for tools
+  fprintf(file, "{\n  \"unit\": \"us\",\n  \"phases\": [\n");
+  for (i = 0; i < PHASE_COUNT; i++)
+  {
+    const PhaseHistogram& h = run[i];
+
+    fprintf(file, "    { \"name\": \"%s\", \"count\": %llu, \"mean\": %.3f, \"p50\": %.3f, \"p95\": %.3f, "
+                  "\"p99\": %.3f, \"max\": %.3f,\n      \"buckets_ns\": [",
+            PhaseName(i), (unsigned long long)h.Count(), h.Mean() / 1000, h.Percentile(0.50) / 1000.0,
+            h.Percentile(0.95) / 1000.0, h.Percentile(0.99) / 1000.0, h.Max() / 1000.0);
+
+    separator = "";
+    for (b = 0; b < PhaseHistogram::BUCKETS; b++)
+    {
+      if (h.BucketCount(b) == 0)
+        continue;
+      fprintf(file, "%s[%llu, %llu]", separator, (unsigned long long)PhaseHistogram::BucketTop(b),
+              (unsigned long long)h.BucketCount(b));
+      separator = ", ";
+    }
+
+    fprintf(file, "] }%s\n", i + 1 < PHASE_COUNT ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+
+  ok = !ferror(file);
+  ok = fclose(file) == 0 && ok;
+
+  return ok ? NULL : "cannot write the timing file";
+}
+
+FrameTimer::~FrameTimer()
+{
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+// Where a frame's time goes, phase by phase.
+//
+// A PhaseScope reads SDL_GetPerformanceCounter when it starts and ends
+// and adds the difference to its phase. Every phase has two histograms:
+// one over the whole run, written to JSON at exit, and one over the last
+// second, which Roll turns into the percentiles the overlay draws.
+//
+// Buckets are 8 per power of two of nanoseconds, so a percentile is at
+// most 12.5% high. Adding is a few relaxed atomic adds and never locks,
+// the simulation thread times its ticks into the same FrameTimer the
+// main thread times its frames into.
+
+#include <atomic>
+#include <stdint.h>
+#include <SDL.h>
+
+#include "Trace.h"
+
+enum Phase
+{
+  PHASE_INPUT,      // SDL_PollEvent and the held keys
+  PHASE_TICK,       // One Game::Step, on the simulation thread
+  PHASE_PARTICLES,  // ParticlePool::Update
+  PHASE_BRICKS,     // Brick layer or brick batch, cleared screen included
+  PHASE_SPRITES,    // Particles, paddle and balls into the batch
+  PHASE_RESTORE,    // Brick layer copied under the dirty rects
+  PHASE_FLUSH,      // GeometryBatch::Flush
+  PHASE_PRESENT,    // SDL_RenderPresent, and the window surface rects
+  PHASE_FRAME,      // Everything from after input to after present
+  PHASE_COUNT
+};
+
+const char* PhaseName(int phase);
+
+class PhaseHistogram
+{
+public:
+  enum
+  {
+    BUCKETS = 16 + 60 * 8  // 0..15 ns one each, then 8 per power of two
+  };
+
+  PhaseHistogram();
+
+  // From any thread
+  void Add(uint64_t nanoseconds);
+
+  uint64_t Count() const;
+  uint64_t Max() const;
+  double Mean() const;
+
+  // Upper edge of the bucket the p-th fraction falls in, never above Max
+  uint64_t Percentile(double p) const;
+
+  // A sample added while it clears may be lost
+  void Clear();
+
+  uint64_t BucketCount(int bucket) const
+  {
+    return counts[bucket].load(std::memory_order_relaxed);
+  }
+
+  static int Bucket(uint64_t nanoseconds);
+  static uint64_t BucketTop(int bucket);
+
+  ~PhaseHistogram();
+
+private:
+  std::atomic<uint32_t> counts[BUCKETS];
+  std::atomic<uint64_t> total;
+  std::atomic<uint64_t> sum;
+  std::atomic<uint64_t> max;
+};
+
+class FrameTimer
+{
+public:
+  struct Summary  // Nanoseconds
+  {
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p95;
+    uint64_t p99;
+    uint64_t max;
+  };
+
+  PhaseHistogram run[PHASE_COUNT];     // Since the start
+  PhaseHistogram recent[PHASE_COUNT];  // Since the last Roll
+  Summary shown[PHASE_COUNT];          // recent as it was at the last Roll
+
+  FrameTimer();
+
+  // Performance counter ticks, from any thread
+  void Add(int phase, Uint64 ticks);
+
+  // Main thread, once a second
+  void Roll();
+
+  // NULL on success, else what went wrong
+  const char* WriteJson(const char* path) const;
+
+  ~FrameTimer();
+
+private:
+  double nanoseconds_per_tick;
+};
+
+// Times its own scope into a phase, and into the trace when there is one
+class PhaseScope
+{
+public:
+  PhaseScope(FrameTimer& timer, int phase)
+    : timer(timer), phase(phase), start(SDL_GetPerformanceCounter())
+  {
+  }
+
+  ~PhaseScope()
+  {
+    Uint64 end = SDL_GetPerformanceCounter();
+
+    timer.Add(phase, end - start);
+    TRACE_COMPLETE(PhaseName(phase), start, end);
+  }
+
+private:
+  FrameTimer& timer;
+  int phase;
+  Uint64 start;
+
+  PhaseScope(const PhaseScope&);
+  PhaseScope& operator=(const PhaseScope&);
+};
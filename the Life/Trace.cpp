@@ -0,0 +1,227 @@
+// fopen is fine here, SDL checks would make it an error
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include "Trace.h"
+
+#include <stdio.h>
+
+#ifdef ARKANOID_TRACE
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+enum
+{
+  MAX_THREADS = 16,
+  RING_SIZE = 1 << 16,  // Events per thread, a power of two
+  WRITE_MS = 10         // Writer wakes up this often
+};
+
+struct TraceEvent
+{
+  const char* name;
+  Uint64 start;
+  Uint64 end;
+};
+
+// head moves only on the thread the ring belongs to, tail only on the
+// writer, each on a cache line of its own
+struct alignas(64) TraceRing
+{
+  std::vector<TraceEvent> events;
+  std::atomic<uint32_t> head;
+  alignas(64) std::atomic<uint32_t> tail;
+  const char* name;
+  uint64_t dropped;  // Written by the owner, read after it ended
+};
+
+std::atomic<bool> trace_enabled(false);
+
+static TraceRing rings[MAX_THREADS];
+static std::atomic<int> ring_count(0);
+static thread_local TraceRing* own_ring = NULL;
+
+static FILE* trace_file = NULL;
+static const char* trace_path = NULL;
+static SDL_Thread* writer = NULL;
+static std::atomic<bool> stop_writer(false);
+static Uint64 origin;          // Counter at TraceStart, time 0 in the file
+static double microseconds;    // Per counter tick
+static long long written;
+static const char* separator;  // Between events
+
+static TraceRing* OwnRing()
+{
+  int i;
+
+  if (own_ring == NULL)
+  {
+    i = ring_count.fetch_add(1, std::memory_order_relaxed);
+    if (i >= MAX_THREADS)
+      return NULL;
+    own_ring = &rings[i];
+  }
+
+  return own_ring;
+}
+
+void TraceThread(const char* name)
+{
+  TraceRing* ring;
+
+  if (!trace_enabled.load(std::memory_order_relaxed))
+    return;
+
+  ring = OwnRing();
+  if (ring != NULL)
+    ring->name = name;
+}
+
+void TraceComplete(const char* name, Uint64 start, Uint64 end)
+{
+  TraceRing* ring = OwnRing();
+  uint32_t head;
+
+  if (ring == NULL)
+    return;
+
+  head = ring->head.load(std::memory_order_relaxed);
+  if (head - ring->tail.load(std::memory_order_acquire) >= RING_SIZE)
+  {
+    ring->dropped++;
+    return;
+  }
+
+  ring->events[head & (RING_SIZE - 1)] = TraceEvent{ name, start, end };
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+// Everything recorded so far into the file, ring by ring
+static void Drain()
+{
+  int count = std::min<int>(ring_count.load(std::memory_order_relaxed), MAX_THREADS);
+  uint32_t head, tail;
+  int i;
+
+  for (i = 0; i < count; i++)
+  {
+    TraceRing& ring = rings[i];
+
+    head = ring.head.load(std::memory_order_acquire);
+    for (tail = ring.tail.load(std::memory_order_relaxed); tail != head; tail++)
+    {
+      const TraceEvent& event = ring.events[tail & (RING_SIZE - 1)];
+
+      fprintf(trace_file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", separator,
+              event.name, i + 1, (double)(Sint64)(event.start - origin) * microseconds,
+              (double)(event.end - event.start) * microseconds);
+      separator = ",\n";
+      written++;
+    }
+    ring.tail.store(tail, std::memory_order_release);
+  }
+}
+
+static int TraceWriter(void*)
+{
+  while (!stop_writer.load(std::memory_order_acquire))
+  {
+    Drain();
+    SDL_Delay(WRITE_MS);
+  }
+
+  Drain();
+  return 0;
+}
+
+const char* TraceStart(const char* path)
+{
+  int i;
+
+  if (trace_file != NULL)
+    return "already tracing";
+
+  trace_file = fopen(path, "w");
+  if (trace_file == NULL)
+    return "cannot create the trace file";
+
+  // All of it up front, recording never allocates
+  for (i = 0; i < MAX_THREADS; i++)
+  {
+    rings[i].events.resize(RING_SIZE);
+    rings[i].head.store(0);
+    rings[i].tail.store(0);
+    rings[i].name = NULL;
+    rings[i].dropped = 0;
+  }
+
+  trace_path = path;
+  origin = SDL_GetPerformanceCounter();
+  microseconds = 1e6 / SDL_GetPerformanceFrequency();
+  written = 0;
+  separator = "";
+  fprintf(trace_file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+  stop_writer.store(false);
+  writer = SDL_CreateThread(TraceWriter, "Trace", NULL);
+  if (writer == NULL)
+  {
+    fclose(trace_file);
+    trace_file = NULL;
+    return "cannot start the trace writer";
+  }
+
+  trace_enabled.store(true);
+  return NULL;
+}
+
+void TraceStop()
+{
+  long long dropped = 0;
+  int count, i;
+  bool ok;
+
+  if (trace_file == NULL)
+    return;
+
+  trace_enabled.store(false);
+  stop_writer.store(true, std::memory_order_release);
+  SDL_WaitThread(writer, NULL);
+
+  // Thread names last, the viewers don't mind where they are
+  count = std::min<int>(ring_count.load(), MAX_THREADS);
+  fprintf(trace_file, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Arcanoid\"}}", separator);
+  for (i = 0; i < count; i++)
+  {
+    if (rings[i].name != NULL)
+      fprintf(trace_file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+              i + 1, rings[i].name);
+    dropped += (long long)rings[i].dropped;
+  }
+  fprintf(trace_file, "\n]}\n");
+
+  ok = !ferror(trace_file);
+  ok = fclose(trace_file) == 0 && ok;
+  trace_file = NULL;
+
+  if (ok)
+    printf("Trace %s: %lld events, %lld dropped on full rings\n", trace_path, written, dropped);
+  else
+    printf("Trace %s: cannot write the trace file\n", trace_path);
+}
+
+#else
+
+const char* TraceStart(const char*)
+{
+  return "built without ARKANOID_TRACE";
+}
+
+void TraceStop()
+{
+}
+
+#endif
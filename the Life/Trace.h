@@ -0,0 +1,52 @@
+#pragma once
+
+// A timeline of what every thread did, as Chrome trace-event JSON that
+// chrome://tracing and ui.perfetto.dev open.
+//
+// Only built with ARKANOID_TRACE defined, which the project's Trace
+// configuration does and Debug and Release don't, and only recording
+// after TraceStart. Every thread writes its events into a ring of its
+// own that only it writes and only the writer thread reads, so recording
+// is three stores and one release store. The writer drains the rings to
+// the file every few milliseconds. A ring that is full drops the event
+// and counts it, the game never waits for the file.
+//
+// An event is one scope with its start and end, a "complete" event in
+// the format, half the size of a begin and end pair. Without
+// ARKANOID_TRACE the macros are empty and TraceStart only says so.
+
+#include <SDL.h>
+
+// NULL on success, else why it isn't tracing. Before the threads that
+// record start
+const char* TraceStart(const char* path);
+
+// Writes what is left and closes the file. After the recording threads end
+void TraceStop();
+
+#ifdef ARKANOID_TRACE
+
+#include <atomic>
+
+extern std::atomic<bool> trace_enabled;
+
+// Names the calling thread in the trace
+void TraceThread(const char* name);
+
+// name has to outlive the trace, a string literal or PhaseName
+void TraceComplete(const char* name, Uint64 start, Uint64 end);
+
+#define TRACE_THREAD(name) TraceThread(name)
+#define TRACE_COMPLETE(name, start, end)                     \
+  do                                                         \
+  {                                                          \
+    if (trace_enabled.load(std::memory_order_relaxed))       \
+      TraceComplete(name, start, end);                       \
+  } while (0)
+
+#else
+
+#define TRACE_THREAD(name) do {} while (0)
+#define TRACE_COMPLETE(name, start, end) do {} while (0)
+
+#endif
@@ -0,0 +1,58 @@
+#pragma once
+
+// Lock-free single writer / single reader triple buffer.
+// The writer fills Back() and calls Publish(), the reader calls Update()
+// and then reads Front(). Each side owns one slot, the third one is
+// handed over with an atomic exchange, so neither side ever waits.
+
+#include <atomic>
+
+template <class T>
+class TripleBuffer
+{
+public:
+  TripleBuffer()
+  {
+    back = 0;
+    middle.store(1);
+    front = 2;
+  }
+
+  // Writer side
+  T& Back()
+  {
+    return slots[back];
+  }
+
+  void Publish()
+  {
+    back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+  }
+
+  // Reader side, true when a newer slot was published since the last call
+  bool Update()
+  {
+    if ((middle.load(std::memory_order_relaxed) & FRESH) == 0)
+      return false;
+
+    front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+    return true;
+  }
+
+  const T& Front() const
+  {
+    return slots[front];
+  }
+
+private:
+  enum
+  {
+    INDEX = 3,
+    FRESH = 4
+  };
+
+  T slots[3];
+  int back;                 // Writer-owned slot
+  std::atomic<int> middle;  // Slot in flight, FRESH when not yet read
+  int front;                // Reader-owned slot
+};